@@ -13,6 +13,7 @@
 #define ALTIMETER_H
 
 #include "esp_err.h"
+#include <stdbool.h>
 #include <time.h>
 
 /* Can run 'make menuconfig' to choose the GPIO to blink,
@@ -34,8 +35,9 @@ typedef struct {
     float altitude_climbed; /*!< Total altitude [meters] measured when climbing up (going down is not counted) */
     float temperature;  /*!< Temperature [deg C] measured with BM180 */
     bool logged;  /*!< This record has been saved to logger before posting */
-    unsigned long up_time;  /*!< Time in seconds since last reboot of ESP32 */
+    unsigned long up_time;  /*!< Time in seconds since power on of ESP32, including deep sleep */
     time_t timestamp;  /*!< Data and time the altitude measurement was taken */
+    unsigned int reference_epoch;  /*!< Epoch of the latest reference pressure update when the measurement was taken */
 } altitude_data;
 
 #ifdef __cplusplus
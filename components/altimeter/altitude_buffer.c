@@ -0,0 +1,89 @@
+/*
+ altitude_buffer.c - Ring buffer of altitude records retained in deep sleep
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "altitude_buffer.h"
+
+static const char* TAG = "Buffer";
+
+RTC_DATA_ATTR static altitude_record buffer[ALTITUDE_BUFFER_SIZE];
+RTC_DATA_ATTR static size_t head = 0;  // Index of the oldest record
+RTC_DATA_ATTR static size_t count = 0;
+RTC_DATA_ATTR static unsigned long overwritten = 0;
+
+
+// Contents of RTC memory may not be valid e.g. after brownout
+static void altitude_buffer_check(void)
+{
+    if (head >= ALTITUDE_BUFFER_SIZE || count > ALTITUDE_BUFFER_SIZE) {
+        ESP_LOGW(TAG, "Invalid state (head %u, count %u), buffer cleared", (unsigned int) head, (unsigned int) count);
+        head = 0;
+        count = 0;
+    }
+}
+
+void altitude_buffer_put(const altitude_data* record)
+{
+    altitude_buffer_check();
+    if (count == ALTITUDE_BUFFER_SIZE) {
+        head = (head + 1) % ALTITUDE_BUFFER_SIZE;
+        count--;
+        overwritten++;
+    }
+    altitude_record* r = &buffer[(head + count) % ALTITUDE_BUFFER_SIZE];
+    r->timestamp = (uint32_t) record->timestamp;
+    r->up_time = (uint32_t) record->up_time;
+    r->pressure = (uint32_t) record->pressure;
+    r->temperature = (int16_t) lroundf(record->temperature * 10);
+    r->reference_epoch = (uint16_t) record->reference_epoch;
+    count++;
+}
+
+size_t altitude_buffer_count(void)
+{
+    altitude_buffer_check();
+    return count;
+}
+
+size_t altitude_buffer_peek(altitude_data* records, size_t max_count)
+{
+    altitude_buffer_check();
+    size_t n = (count < max_count) ? count : max_count;
+    for (size_t i = 0; i < n; i++) {
+        const altitude_record* r = &buffer[(head + i) % ALTITUDE_BUFFER_SIZE];
+        memset(&records[i], 0, sizeof(altitude_data));
+        records[i].pressure = r->pressure;
+        records[i].reference_epoch = r->reference_epoch;
+        records[i].temperature = r->temperature / 10.0;
+        records[i].timestamp = r->timestamp;
+        records[i].up_time = r->up_time;
+    }
+    return n;
+}
+
+void altitude_buffer_drop(size_t n)
+{
+    altitude_buffer_check();
+    if (n > count) {
+        n = count;
+    }
+    head = (head + n) % ALTITUDE_BUFFER_SIZE;
+    count -= n;
+}
+
+unsigned long altitude_buffer_overwritten(void)
+{
+    return overwritten;
+}
@@ -0,0 +1,73 @@
+/*
+ altitude_buffer.h - Ring buffer of altitude records retained in deep sleep
+
+ Records are kept in RTC memory in compact form, so they survive deep sleep
+ and may be uploaded in batches. Once the buffer is full, the oldest record
+ is overwritten. Records keep raw pressure and epoch of reference pressure,
+ altitude is computed when records are uploaded.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef ALTITUDE_BUFFER_H
+#define ALTITUDE_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "altimeter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ALTITUDE_BUFFER_SIZE 96  // Number of records, 16 bytes each
+
+typedef struct {
+    uint32_t timestamp;  /*!< Calendar time [s] the record was taken */
+    uint32_t up_time;  /*!< Module up time [s] the record was taken */
+    uint32_t pressure;  /*!< Pressure [Pa] */
+    int16_t temperature;  /*!< Temperature [0.1 deg C] */
+    uint16_t reference_epoch;  /*!< Epoch of reference pressure current when the record was taken */
+} altitude_record;
+
+/**
+@brief Append record to the buffer, overwriting the oldest one if buffer is full
+*/
+void altitude_buffer_put(const altitude_data* record);
+
+/**
+@brief Number of records in the buffer
+*/
+size_t altitude_buffer_count(void);
+
+/**
+@brief Copy oldest records from the buffer without removing them
+
+Only pressure, temperature, calendar and up time, and reference epoch are set.
+
+@param records where to copy records to
+@param max_count maximum number of records to copy
+
+@return number of records copied
+*/
+size_t altitude_buffer_peek(altitude_data* records, size_t max_count);
+
+/**
+@brief Remove 'count' oldest records, e.g. once they have been uploaded
+*/
+void altitude_buffer_drop(size_t count);
+
+/**
+@brief Number of records overwritten before they have been removed
+*/
+unsigned long altitude_buffer_overwritten(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ALTITUDE_BUFFER_H
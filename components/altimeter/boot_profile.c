@@ -0,0 +1,121 @@
+/*
+ boot_profile.c - Time spent in phases of the wake cycle
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "boot_profile.h"
+
+static const char* TAG = "Profile";
+
+// Names are compared across firmware versions in logs, keep them unchanged
+static const char* phase_names[BOOT_PHASE_MAX] = {
+    "boot", "sensor", "wifi", "ref", "measure", "upload", "awake"
+};
+
+// History of durations [ms], retained in deep sleep
+RTC_DATA_ATTR static uint16_t history[BOOT_PHASE_MAX][BOOT_PROFILE_HISTORY];
+RTC_DATA_ATTR static uint8_t history_next[BOOT_PHASE_MAX];
+RTC_DATA_ATTR static uint8_t history_count[BOOT_PHASE_MAX];
+
+// Current wake up, timestamps [ms] since reset
+static uint32_t phase_start[BOOT_PHASE_MAX];
+static uint32_t phase_time[BOOT_PHASE_MAX];
+static bool phase_ended[BOOT_PHASE_MAX];
+
+
+void boot_profile_begin(boot_phase phase)
+{
+    phase_start[phase] = esp_log_timestamp();
+}
+
+void boot_profile_end(boot_phase phase)
+{
+    phase_time[phase] += esp_log_timestamp() - phase_start[phase];
+    phase_ended[phase] = true;
+}
+
+void boot_profile_commit(void)
+{
+    for (int phase = 0; phase < BOOT_PHASE_MAX; phase++) {
+        if (phase_ended[phase] == false) {
+            continue;
+        }
+        // contents of RTC memory may not be valid e.g. after brownout
+        if (history_next[phase] >= BOOT_PROFILE_HISTORY || history_count[phase] > BOOT_PROFILE_HISTORY) {
+            history_next[phase] = 0;
+            history_count[phase] = 0;
+        }
+        history[phase][history_next[phase]] = (phase_time[phase] > UINT16_MAX) ? UINT16_MAX : phase_time[phase];
+        history_next[phase] = (history_next[phase] + 1) % BOOT_PROFILE_HISTORY;
+        if (history_count[phase] < BOOT_PROFILE_HISTORY) {
+            history_count[phase]++;
+        }
+        phase_time[phase] = 0;
+        phase_ended[phase] = false;
+    }
+}
+
+void boot_profile_get_stats(boot_phase phase, boot_phase_stats* stats)
+{
+    uint16_t sorted[BOOT_PROFILE_HISTORY];
+    unsigned int count = history_count[phase];
+    uint32_t sum = 0;
+
+    stats->count = 0;
+    if (count == 0 || count > BOOT_PROFILE_HISTORY) {
+        return;
+    }
+    // insertion sort, as history is short
+    for (unsigned int i = 0; i < count; i++) {
+        uint16_t duration = history[phase][i];
+        unsigned int j = i;
+        for (; j > 0 && sorted[j - 1] > duration; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = duration;
+        sum += duration;
+    }
+    stats->count = count;
+    stats->min = sorted[0];
+    stats->avg = (sum + count / 2) / count;
+    // nearest rank
+    stats->p95 = sorted[(95 * count + 99) / 100 - 1];
+}
+
+int boot_profile_format(char* buf, size_t size)
+{
+    boot_phase_stats stats;
+    size_t pos = 0;
+
+    if (size > 0) {
+        buf[0] = '\0';
+    }
+    for (int phase = 0; phase < BOOT_PHASE_MAX; phase++) {
+        boot_profile_get_stats(phase, &stats);
+        if (stats.count == 0) {
+            continue;
+        }
+        pos += snprintf((pos < size) ? buf + pos : NULL, (pos < size) ? size - pos : 0,
+            "%s%s %u/%u/%u", (pos > 0) ? " " : "", phase_names[phase], stats.min, stats.avg, stats.p95);
+    }
+    return pos;
+}
+
+void boot_profile_log(void)
+{
+    char buf[192];
+
+    boot_profile_format(buf, sizeof(buf));
+    ESP_LOGI(TAG, "min/avg/p95 [ms] of last %d: %s", BOOT_PROFILE_HISTORY, buf);
+}
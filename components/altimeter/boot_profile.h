@@ -0,0 +1,86 @@
+/*
+ boot_profile.h - Time spent in phases of the wake cycle
+
+ Duration of each phase is recorded on every wake up and the last
+ BOOT_PROFILE_HISTORY durations are kept in RTC memory, so statistics
+ cover many deep sleep cycles. Phases not started with boot_profile_begin()
+ are timed since reset, e.g. the startup before app_main()
+ or the whole time awake.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_PROFILE_HISTORY 16  // Number of durations kept per phase
+
+typedef enum {
+    BOOT_PHASE_STARTUP,  /*!< From reset to app_main() */
+    BOOT_PHASE_SENSOR,  /*!< Sensor initialization and start of conversion */
+    BOOT_PHASE_WIFI,  /*!< Wi-Fi association and obtaining IP */
+    BOOT_PHASE_REFERENCE,  /*!< Waiting for reference pressure once the network is up, logged as "ref" */
+    BOOT_PHASE_MEASURE,  /*!< Reading out the sensor and computing altitude */
+    BOOT_PHASE_UPLOAD,  /*!< Posting samples to ThingSpeak */
+    BOOT_PHASE_AWAKE,  /*!< From reset to entering deep sleep */
+    BOOT_PHASE_MAX
+} boot_phase;
+
+typedef struct {
+    unsigned int count;  /*!< Number of durations the statistics are computed from */
+    uint16_t min;  /*!< Shortest duration [ms] */
+    uint16_t avg;  /*!< Average duration [ms] */
+    uint16_t p95;  /*!< 95th percentile of duration [ms] */
+} boot_phase_stats;
+
+void boot_profile_begin(boot_phase phase);
+
+/**
+@brief Stop timing the phase
+
+Phase may be begun and ended several times per wake up, its durations add up.
+*/
+void boot_profile_end(boot_phase phase);
+
+/**
+@brief Add durations of phases ended since previous commit to the history
+
+Call once per wake up, or once per sample when running persistently.
+Phases that have not been ended, e.g. skipped Wi-Fi connection,
+do not affect their statistics.
+*/
+void boot_profile_commit(void);
+
+/**
+@brief Compute statistics of the phase from durations in the history
+*/
+void boot_profile_get_stats(boot_phase phase, boot_phase_stats* stats);
+
+/**
+@brief Format statistics of all phases with any history into compact string
+
+Each phase is represented as "name min/avg/p95" in milliseconds, e.g.
+"wifi 812/930/1410 ref 20/45/310".
+
+@return number of characters the complete string takes, as snprintf()
+*/
+int boot_profile_format(char* buf, size_t size);
+
+void boot_profile_log(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BOOT_PROFILE_H
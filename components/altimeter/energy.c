@@ -0,0 +1,174 @@
+/*
+ energy.c - Estimate of charge drawn from the battery
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "energy.h"
+
+static const char* TAG = "Energy";
+
+// Current [uA] in each state
+static const uint32_t current[ENERGY_STATE_MAX] = {
+    CONFIG_ENERGY_CURRENT_CPU,
+    CONFIG_ENERGY_CURRENT_RADIO,
+    CONFIG_ENERGY_CURRENT_MODEM_SLEEP,
+    CONFIG_ENERGY_CURRENT_DEEP_SLEEP,
+    CONFIG_ENERGY_CURRENT_SD_CARD
+};
+
+static const char* state_names[ENERGY_STATE_MAX] = {
+    "cpu", "radio", "modem sleep", "deep sleep", "sd card"
+};
+
+#define UA_MS_PER_MAH 3600000000.0  // 1 mAh = 1000 uA * 3600 s * 1000 ms
+
+// Time [ms] in each state since power on
+RTC_DATA_ATTR static uint64_t total_ms[ENERGY_STATE_MAX];
+RTC_DATA_ATTR static unsigned long total_samples = 0;
+
+// Time [ms] in each state since wake up
+static uint32_t wake_ms[ENERGY_STATE_MAX];
+
+static energy_state state = ENERGY_CPU;
+static uint32_t state_start = 0;  // Time [ms] since reset the current state started
+static bool sd_card_active = false;
+static uint32_t sd_card_start;
+
+/* State is switched from main task, network stage and timer callbacks,
+   so read-modify-write of the totals is done holding this lock
+ */
+static portMUX_TYPE energy_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+// Call holding energy_lock
+static void energy_add_locked(energy_state s, uint32_t time_ms)
+{
+    total_ms[s] += time_ms;
+    wake_ms[s] += time_ms;
+}
+
+void energy_add(energy_state s, uint32_t time_ms)
+{
+    portENTER_CRITICAL(&energy_lock);
+    energy_add_locked(s, time_ms);
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_start(void)
+{
+    portENTER_CRITICAL(&energy_lock);
+    state = ENERGY_CPU;
+    state_start = 0;
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_set_state(energy_state new_state)
+{
+    if (new_state == ENERGY_SD_CARD) {
+        return;
+    }
+    portENTER_CRITICAL(&energy_lock);
+    uint32_t now = esp_log_timestamp();
+    energy_add_locked(state, now - state_start);
+    state = new_state;
+    state_start = now;
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_sd_card(bool active)
+{
+    portENTER_CRITICAL(&energy_lock);
+    uint32_t now = esp_log_timestamp();
+    if (active != sd_card_active) {
+        if (active) {
+            sd_card_start = now;
+        } else {
+            energy_add_locked(ENERGY_SD_CARD, now - sd_card_start);
+        }
+        sd_card_active = active;
+    }
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_deep_sleep(uint32_t sleep_ms)
+{
+    energy_sd_card(false);
+    energy_set_state(ENERGY_DEEP_SLEEP);
+    energy_add(ENERGY_DEEP_SLEEP, sleep_ms);
+}
+
+void energy_count_samples(unsigned int count)
+{
+    portENTER_CRITICAL(&energy_lock);
+    total_samples += count;
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_get_report(energy_report* report)
+{
+    uint64_t totals[ENERGY_STATE_MAX];
+    uint32_t wake[ENERGY_STATE_MAX];
+    unsigned long samples;
+    double charge = 0.0;
+    double wake_charge = 0.0;
+    uint64_t elapsed_ms = 0;
+
+    portENTER_CRITICAL(&energy_lock);
+    for (int s = 0; s < ENERGY_STATE_MAX; s++) {
+        totals[s] = total_ms[s];
+        wake[s] = wake_ms[s];
+    }
+    samples = total_samples;
+    portEXIT_CRITICAL(&energy_lock);
+
+    for (int s = 0; s < ENERGY_STATE_MAX; s++) {
+        charge += (double) totals[s] * current[s] / UA_MS_PER_MAH;
+        wake_charge += (double) wake[s] * current[s] / UA_MS_PER_MAH;
+        if (s != ENERGY_SD_CARD) {
+            elapsed_ms += totals[s];
+        }
+    }
+    report->samples = samples;
+    report->charge = charge;
+    report->wake_charge = wake_charge;
+    report->sample_charge = (samples > 0) ? charge / samples : 0.0;
+    report->average_current = (elapsed_ms > 0) ? charge / (elapsed_ms / 3600000.0) : 0.0;
+    if (report->average_current > 0.0) {
+        report->runtime = CONFIG_ENERGY_BATTERY_CAPACITY / report->average_current;
+        report->remaining = (CONFIG_ENERGY_BATTERY_CAPACITY - charge) / report->average_current;
+    } else {
+        report->runtime = 0.0;
+        report->remaining = 0.0;
+    }
+}
+
+void energy_log(void)
+{
+    energy_report report;
+
+    energy_get_report(&report);
+    for (int s = 0; s < ENERGY_STATE_MAX; s++) {
+        if (wake_ms[s] > 0) {
+            ESP_LOGD(TAG, "Wake %s %u ms, %0.4f mAh", state_names[s], wake_ms[s], (double) wake_ms[s] * current[s] / UA_MS_PER_MAH);
+        }
+    }
+    ESP_LOGI(TAG, "Wake %0.4f mAh, total %0.1f mAh, %lu samples, %0.4f mAh per sample",
+        report.wake_charge, report.charge, report.samples, report.sample_charge);
+    ESP_LOGI(TAG, "Average %0.2f mA, projected runtime %0.1f h, %0.1f h left",
+        report.average_current, report.runtime, report.remaining);
+    portENTER_CRITICAL(&energy_lock);
+    for (int s = 0; s < ENERGY_STATE_MAX; s++) {
+        wake_ms[s] = 0;
+    }
+    portEXIT_CRITICAL(&energy_lock);
+}
@@ -0,0 +1,88 @@
+/*
+ energy.h - Estimate of charge drawn from the battery
+
+ Time spent in each power state is converted into charge
+ with the current table set in menuconfig. Totals are retained
+ in deep sleep and counted since power on, i.e. since battery is connected.
+
+ CPU, radio, modem sleep and deep sleep states are exclusive,
+ SD card current is added on top of them when the card is active.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ENERGY_CPU,  /*!< CPU running, Wi-Fi off */
+    ENERGY_RADIO,  /*!< Wi-Fi receiving or transmitting */
+    ENERGY_MODEM_SLEEP,  /*!< Wi-Fi connected in modem sleep */
+    ENERGY_DEEP_SLEEP,
+    ENERGY_SD_CARD,  /*!< SD card active, in addition to one of the states above */
+    ENERGY_STATE_MAX
+} energy_state;
+
+typedef struct {
+    unsigned long samples;  /*!< Samples taken since power on */
+    float charge;  /*!< Charge [mAh] used since power on */
+    float wake_charge;  /*!< Charge [mAh] used since wake up or previous energy_log(), including deep sleep accounted ahead */
+    float sample_charge;  /*!< Average charge [mAh] per sample */
+    float average_current;  /*!< Average current [mA] since power on */
+    float runtime;  /*!< Projected runtime [h] on full battery at average current */
+    float remaining;  /*!< Projected runtime [h] left */
+} energy_report;
+
+/**
+@brief Start accounting on wake up
+
+Time since reset is accounted as CPU running, that is the current state.
+*/
+void energy_start(void);
+
+/**
+@brief Switch to one of exclusive states, accounting time spent in the current one
+*/
+void energy_set_state(energy_state state);
+
+void energy_sd_card(bool active);
+
+/**
+@brief Account time spent in a state outside of energy_set_state(), e.g. by wake stub
+*/
+void energy_add(energy_state state, uint32_t time_ms);
+
+/**
+@brief Account time in the current state and deep sleep to be entered
+
+Call just before entering deep sleep.
+
+@param sleep_ms time [ms] of deep sleep
+*/
+void energy_deep_sleep(uint32_t sleep_ms);
+
+void energy_count_samples(unsigned int count);
+
+void energy_get_report(energy_report* report);
+
+/**
+@brief Log the report and start counting charge of the next wake up
+*/
+void energy_log(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ENERGY_H
@@ -0,0 +1,79 @@
+/*
+ reference_history.c - Reference pressure updates retained in deep sleep
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdbool.h>
+#include "esp_attr.h"
+
+#include "reference_history.h"
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t pressure;
+} reference_point;
+
+// Update of epoch 'e' is at index e % REFERENCE_HISTORY_SIZE
+RTC_DATA_ATTR static reference_point points[REFERENCE_HISTORY_SIZE];
+RTC_DATA_ATTR static uint32_t latest = 0;  // Epoch of the latest update, 0 - none
+
+
+uint16_t reference_history_add(uint32_t timestamp, unsigned long pressure)
+{
+    latest++;
+    points[latest % REFERENCE_HISTORY_SIZE].timestamp = timestamp;
+    points[latest % REFERENCE_HISTORY_SIZE].pressure = pressure;
+    return (uint16_t) latest;
+}
+
+uint16_t reference_history_epoch(void)
+{
+    return (uint16_t) latest;
+}
+
+// Update of 'epoch' is kept
+static bool reference_history_kept(uint32_t epoch)
+{
+    return epoch > 0 && epoch <= latest && latest - epoch < REFERENCE_HISTORY_SIZE;
+}
+
+unsigned long reference_history_at(uint16_t epoch, uint32_t timestamp)
+{
+    if (latest == 0) {
+        return 0;
+    }
+    // sample has been taken at most 65535 updates ago
+    uint16_t age = (uint16_t) latest - epoch;
+    if (age > latest) {
+        age = latest;
+    }
+    uint32_t lower = latest - age;
+    uint32_t upper = lower + 1;
+
+    if (reference_history_kept(lower) && reference_history_kept(upper)) {
+        const reference_point* a = &points[lower % REFERENCE_HISTORY_SIZE];
+        const reference_point* b = &points[upper % REFERENCE_HISTORY_SIZE];
+        if (timestamp <= a->timestamp || b->timestamp <= a->timestamp) {
+            return a->pressure;
+        }
+        if (timestamp >= b->timestamp) {
+            return b->pressure;
+        }
+        int64_t span = (int64_t) b->pressure - a->pressure;
+        return a->pressure + span * (timestamp - a->timestamp) / (b->timestamp - a->timestamp);
+    }
+    if (reference_history_kept(lower)) {
+        return points[lower % REFERENCE_HISTORY_SIZE].pressure;
+    }
+    // taken before the first update or the oldest updates are gone
+    if (reference_history_kept(upper) == false) {
+        upper = (latest < REFERENCE_HISTORY_SIZE) ? 1 : latest - REFERENCE_HISTORY_SIZE + 1;
+    }
+    return points[upper % REFERENCE_HISTORY_SIZE].pressure;
+}
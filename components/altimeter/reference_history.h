@@ -0,0 +1,59 @@
+/*
+ reference_history.h - Reference pressure updates retained in deep sleep
+
+ Each reference pressure retrieved from weather station is numbered
+ with an epoch. Samples keep the epoch current when they were taken,
+ so their altitude may be computed later against reference pressure
+ interpolated between updates that bracket the sample.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef REFERENCE_HISTORY_H
+#define REFERENCE_HISTORY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REFERENCE_HISTORY_SIZE 8  // Number of the latest updates kept
+
+/**
+@brief Save reference pressure update
+
+@param timestamp time [s] of the update, in the same time base as samples
+@param pressure reference pressure [Pa]
+
+@return epoch of the update
+*/
+uint16_t reference_history_add(uint32_t timestamp, unsigned long pressure);
+
+/**
+@brief Epoch of the latest update, 0 if there has been no update yet
+*/
+uint16_t reference_history_epoch(void);
+
+/**
+@brief Get reference pressure for a sample
+
+Reference is interpolated between update of 'epoch' and the next one,
+if both are still kept. Otherwise the closest update kept is used.
+
+@param epoch epoch current when the sample was taken
+@param timestamp time [s] the sample was taken
+
+@return reference pressure [Pa], 0 if there has been no update yet
+*/
+unsigned long reference_history_at(uint16_t epoch, uint32_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // REFERENCE_HISTORY_H
@@ -0,0 +1,83 @@
+/*
+ sample_scheduler.c - Adaptive sample period driven by vertical speed
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "sample_scheduler.h"
+
+
+void sample_scheduler_init(sample_scheduler* scheduler, const sample_scheduler_config* config)
+{
+    scheduler->config = *config;
+    scheduler->primed = false;
+    scheduler->speed = 0.0;
+    scheduler->noise = 0.0;
+    scheduler->period = config->period_min;
+    scheduler->refresh_interval = config->refresh_min;
+    scheduler->reference_age = 0;
+}
+
+unsigned int sample_scheduler_update(sample_scheduler* scheduler, float altitude, unsigned int elapsed)
+{
+    const sample_scheduler_config* config = &scheduler->config;
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    scheduler->reference_age += elapsed;
+    if (scheduler->primed == false) {
+        scheduler->primed = true;
+        scheduler->altitude_last = altitude;
+        scheduler->period = config->period_min;
+        return scheduler->period;
+    }
+
+    float delta = altitude - scheduler->altitude_last;
+    scheduler->altitude_last = altitude;
+    scheduler->noise += (fabsf(delta - scheduler->speed * elapsed) - scheduler->noise) / 4;
+    scheduler->speed += (delta / elapsed - scheduler->speed) / 2;
+
+    // vertical speed that cannot be explained by noise
+    float speed = fabsf(scheduler->speed) - scheduler->noise / elapsed;
+    float period = config->period_max;
+    if (speed > 0 && config->altitude_step / speed < period) {
+        period = config->altitude_step / speed;
+    }
+    if (period > 2 * scheduler->period) {
+        period = 2 * scheduler->period;
+    }
+    if (period < config->period_min) {
+        period = config->period_min;
+    }
+    scheduler->period = (unsigned int) period;
+    return scheduler->period;
+}
+
+bool sample_scheduler_reference_due(const sample_scheduler* scheduler)
+{
+    return scheduler->reference_age >= scheduler->refresh_interval;
+}
+
+void sample_scheduler_reference_updated(sample_scheduler* scheduler, unsigned long reference_old, unsigned long reference_new)
+{
+    const sample_scheduler_config* config = &scheduler->config;
+
+    if (labs((long) reference_new - (long) reference_old) < SAMPLE_SCHEDULER_REFERENCE_STABLE) {
+        scheduler->refresh_interval *= 2;
+        if (scheduler->refresh_interval > config->refresh_max) {
+            scheduler->refresh_interval = config->refresh_max;
+        }
+    } else {
+        scheduler->refresh_interval = config->refresh_min;
+    }
+    scheduler->reference_age = 0;
+}
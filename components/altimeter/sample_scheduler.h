@@ -0,0 +1,79 @@
+/*
+ sample_scheduler.h - Adaptive sample period driven by vertical speed
+
+ Next sample period is the time it takes to climb altitude step
+ at current vertical speed, so sampling is fast on stairs and slow at rest.
+ Vertical speed is a moving average of altitude changes, reduced by
+ altitude noise, so noise alone does not look like climbing.
+ Period may drop to the lower bound right away, but grows at most
+ twice per sample, so climbing that resumes is not missed for long.
+
+ Reference pressure refresh interval doubles each time the new reference
+ is close to the previous one, and drops to the lower bound once it changes.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef SAMPLE_SCHEDULER_H
+#define SAMPLE_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAMPLE_SCHEDULER_REFERENCE_STABLE 50  // Change of reference pressure [Pa] considered insignificant
+
+typedef struct {
+    float altitude_step;  /*!< Altitude [m] to climb between samples */
+    unsigned int period_min;  /*!< Shortest sample period [s] */
+    unsigned int period_max;  /*!< Longest sample period [s] */
+    unsigned int refresh_min;  /*!< Shortest reference pressure refresh interval [s] */
+    unsigned int refresh_max;  /*!< Longest reference pressure refresh interval [s] */
+} sample_scheduler_config;
+
+typedef struct {
+    sample_scheduler_config config;
+    bool primed;  /*!< Altitude of previous sample is known */
+    float altitude_last;  /*!< Altitude [m] of previous sample */
+    float speed;  /*!< Vertical speed [m/s], moving average */
+    float noise;  /*!< Altitude noise [m], moving average of deviation from altitude predicted with speed */
+    unsigned int period;  /*!< Next sample period [s] */
+    unsigned int refresh_interval;  /*!< Current reference pressure refresh interval [s] */
+    unsigned long reference_age;  /*!< Time [s] since reference pressure was refreshed */
+} sample_scheduler;
+
+void sample_scheduler_init(sample_scheduler* scheduler, const sample_scheduler_config* config);
+
+/**
+@brief Account for new altitude sample and compute next sample period
+
+@param scheduler scheduler state, e.g. retained in RTC memory
+@param altitude altitude [m] of the sample
+@param elapsed time [s] since previous sample
+
+@return next sample period [s]
+*/
+unsigned int sample_scheduler_update(sample_scheduler* scheduler, float altitude, unsigned int elapsed);
+
+/**
+@brief Check if reference pressure should be refreshed
+*/
+bool sample_scheduler_reference_due(const sample_scheduler* scheduler);
+
+/**
+@brief Account for reference pressure update, adjusting refresh interval
+*/
+void sample_scheduler_reference_updated(sample_scheduler* scheduler, unsigned long reference_old, unsigned long reference_new);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SAMPLE_SCHEDULER_H
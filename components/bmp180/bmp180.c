@@ -11,21 +11,23 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "rom/crc.h"
+#include "rom/rtc.h"
 
-#include <math.h>
+#include <string.h>
 
 #include "bmp180.h"
-#include "twi.h"
+#include "pressure_sensor.h"
+#include "twi_bus.h"
 
 static const char* TAG = "BMP180";
 
 #define BMP180_ADDRESS 0x77  // I2C address of BMP180
+#define BMP180_BUS_PRIORITY 6  // Above application tasks (5), so pressure reads are not held up by other devices on the bus
 
-#define BMP180_ULTRA_LOW_POWER  0
-#define BMP180_STANDARD         1
-#define BMP180_HIGH_RES         2
-#define BMP180_ULTRA_HIGH_RES   3
+static twi_device* bmp180_device = NULL;
 
 #define BMP180_CAL_AC1          0xAA  // Calibration data (16 bits)
 #define BMP180_CAL_AC2          0xAC  // Calibration data (16 bits)
@@ -38,40 +40,89 @@ static const char* TAG = "BMP180";
 #define BMP180_CAL_MB           0xBA  // Calibration data (16 bits)
 #define BMP180_CAL_MC           0xBC  // Calibration data (16 bits)
 #define BMP180_CAL_MD           0xBE  // Calibration data (16 bits)
+#define BMP180_CAL_SIZE         22    // Size of calibration data block starting at BMP180_CAL_AC1
 
 #define BMP180_CONTROL             0xF4  // Control register
 #define BMP180_DATA_TO_READ        0xF6  // Read results here
 #define BMP180_READ_TEMP_CMD       0x2E  // Request temperature measurement
 #define BMP180_READ_PRESSURE_CMD   0x34  // Request pressure measurement
+#define BMP180_CONTROL_SCO         0x20  // Start of conversion bit, cleared when conversion is complete
 
-// Calibration parameters
-static int16_t ac1;
-static int16_t ac2;
-static int16_t ac3;
-static uint16_t ac4;
-static uint16_t ac5;
-static uint16_t ac6;
-static int16_t b1;
-static int16_t b2;
-static int16_t mb;
-static int16_t mc;
-static int16_t md;
+// Worst case conversion times as per datasheet
+#define BMP180_TEMP_CONVERSION_MS  5
+#define pressure_conversion_ms(oss) (2 + (3 << (oss)))
+
+// Extra time to wait beyond datasheet conversion time
+// before giving up polling for end of conversion
+#define BMP180_POLL_TIMEOUT_MARGIN_MS 5
+
+/* Calibration parameters
+   Kept in RTC memory together with checksum,
+   so they do not need to be read again from sensor's EEPROM
+   when waking up from deep sleep
+ */
+RTC_DATA_ATTR static bmp180_calibration calib;
+RTC_DATA_ATTR static uint32_t calib_checksum;
 static uint8_t oversampling = BMP180_ULTRA_HIGH_RES;
+// Oversampling of pressure conversion in progress
+static uint8_t conversion_oversampling = BMP180_ULTRA_HIGH_RES;
+
+/* Uncompensated temperature cached
+   to be reused by bmp180_read_sample() across several pressure reads.
+   Kept in RTC memory so it survives deep sleep between samples.
+ */
+RTC_DATA_ATTR static int16_t ut_cached;
+RTC_DATA_ATTR static unsigned int b5_reads_left = 0;
+static unsigned int b5_reuse_count = 0;
+
+// Set if any I2C transaction failed since last cleared
+static bool read_failed = false;
+
+// Poll for end of conversion instead of waiting worst case conversion time
+static bool conversion_polling = false;
+static bmp180_conversion_stats conversion_stats = {0};
+
+// Conversion in progress
+static TickType_t conversion_start;
+static uint8_t conversion_time_ms;
+
+/* State of measurement started with bmp180_start_sample()
+   and advanced with bmp180_poll()
+ */
+typedef enum {
+    BMP180_STATE_IDLE,
+    BMP180_STATE_TEMPERATURE,
+    BMP180_STATE_PRESSURE,
+    BMP180_STATE_READY,
+    BMP180_STATE_FAILED
+} bmp180_state;
+
+static bmp180_state state = BMP180_STATE_IDLE;
+static uint32_t up_collected;
+
+/* Read 'len' consecutive registers starting from 'reg'
+   Sensor auto-increments register address,
+   so the whole range is read with single read transfer.
+   Register address and read are combined in one transaction
+   with repeated start, saving a stop / start and bus turnaround
+ */
+uint8_t bmp180_read_bytes(uint8_t reg, uint8_t* buff, unsigned int len)
+{
+    int rc = twi_device_write_read(bmp180_device, &reg, 1, buff, len);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Read [%02x] failed rc=%d", reg, rc);
+        read_failed = true;
+    }
+    return rc;
+}
 
 int bmp180_read_int16(uint8_t reg)
 {
     uint8_t buff[2] = {0};
     int16_t data = 0;
 
-    int rc = twi_writeTo(BMP180_ADDRESS, &reg, 1, true);
-    if (rc == 0) {
-        rc = twi_readFrom(BMP180_ADDRESS, buff, 2, true);
-        if (rc == 0) {
-            data = (int16_t) buff[0]<<8 | buff[1];
-        }
-    }
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Read [%02x] failed rc=%d", reg, rc);
+    if (bmp180_read_bytes(reg, buff, 2) == 0) {
+        data = (int16_t) buff[0]<<8 | buff[1];
     }
     return data;
 }
@@ -81,86 +132,159 @@ uint8_t bmp180_write(uint8_t reg, uint8_t data)
     uint8_t ret=0;
     uint8_t buf[] = {reg, data};
 
-    ret = twi_writeTo(BMP180_ADDRESS, buf, 2, true);
+    ret = twi_device_write(bmp180_device, buf, 2);
     if (ret != 0) {
         ESP_LOGE(TAG, "Write [%02x]=%02x failed", reg, data);
+        read_failed = true;
     }
     return ret;
 }
 
 
+static uint8_t bmp180_read_control(void)
+{
+    uint8_t data = 0;
+
+    if (bmp180_read_bytes(BMP180_CONTROL, &data, 1) != 0) {
+        // do not poll on a bus that does not respond
+        data = 0;
+    }
+    return data;
+}
+
+static void start_conversion(uint8_t command, uint8_t wait_time_ms)
+{
+    bmp180_write(BMP180_CONTROL, command);
+    conversion_start = xTaskGetTickCount();
+    conversion_time_ms = wait_time_ms;
+}
+
+/* Check without blocking if conversion is complete
+   - either after datasheet worst case 'conversion_time_ms'
+   - or, if polling is enabled, when Sco bit of control register is cleared,
+     but not later than 'conversion_time_ms' + BMP180_POLL_TIMEOUT_MARGIN_MS
+ */
+static bool conversion_complete(void)
+{
+    TickType_t elapsed = xTaskGetTickCount() - conversion_start;
+
+    if (conversion_polling == false) {
+        return elapsed * portTICK_RATE_MS >= conversion_time_ms;
+    }
+
+    if ((bmp180_read_control() & BMP180_CONTROL_SCO) != 0) {
+        if (elapsed * portTICK_RATE_MS < conversion_time_ms + BMP180_POLL_TIMEOUT_MARGIN_MS) {
+            return false;
+        }
+        ESP_LOGW(TAG, "Conversion not complete after %u ms", elapsed * portTICK_RATE_MS);
+        conversion_stats.timeouts++;
+    }
+
+    unsigned long actual_ms = elapsed * portTICK_RATE_MS;
+    conversion_stats.conversions++;
+    conversion_stats.time_actual_ms += actual_ms;
+    conversion_stats.time_budget_ms += conversion_time_ms;
+    if (actual_ms > conversion_stats.time_actual_max_ms) {
+        conversion_stats.time_actual_max_ms = actual_ms;
+    }
+    return true;
+}
+
+static void wait_for_conversion(void)
+{
+    while (conversion_complete() == false) {
+        if (conversion_polling == true) {
+            vTaskDelay(1);
+        } else {
+            TickType_t elapsed = xTaskGetTickCount() - conversion_start;
+            vTaskDelay(conversion_time_ms / portTICK_RATE_MS - elapsed);
+        }
+    }
+}
+
+static uint32_t read_uncompensated_pressure_result(void)
+{
+    uint8_t buff[3] = {0};
+    uint32_t data = 0;
+
+    if (bmp180_read_bytes(BMP180_DATA_TO_READ, buff, 3) == 0) {
+        data = (uint32_t) buff[0]<<16 | buff[1]<<8 | buff[2];
+        data >>= (8 - conversion_oversampling);
+    }
+    return data;
+}
+
 int16_t bmp180_read_uncompensated_temperature()
 {
-    bmp180_write(BMP180_CONTROL, BMP180_READ_TEMP_CMD);
-    vTaskDelay(5 / portTICK_RATE_MS);
+    start_conversion(BMP180_READ_TEMP_CMD, BMP180_TEMP_CONVERSION_MS);
+    wait_for_conversion();
     return bmp180_read_int16(BMP180_DATA_TO_READ);
 }
 
-int16_t calculate_b5()
+/* Compensation of raw readings as per BMP180 datasheet
+   Pure functions of calibration and raw readings,
+   so they can be applied to readings taken and saved earlier
+ */
+static inline int32_t compensate_b5(const bmp180_calibration* c, int16_t ut)
 {
-    int16_t ut;
     int32_t x1, x2;
 
-    ut = bmp180_read_uncompensated_temperature();
-    x1 = ((ut - (int32_t) ac6) * (int32_t) ac5) >> 15;
-    x2 = ((int32_t) mc << 11) / (x1 + md);
+    x1 = ((ut - (int32_t) c->ac6) * (int32_t) c->ac5) >> 15;
+    x2 = ((int32_t) c->mc << 11) / (x1 + c->md);
     return x1 + x2;
 }
 
+static inline float compensate_temperature(int32_t b5)
+{
+    return ((b5 + 8) >> 4) / 10.0;
+}
+
+int16_t calculate_b5()
+{
+    return compensate_b5(&calib, bmp180_read_uncompensated_temperature());
+}
+
 float bmp180_read_temperature(void)
 {
     int16_t b5;
 
     b5 = calculate_b5();
-    return ((b5 + 8) >> 4) / 10.0;
+    return compensate_temperature(b5);
 }
 
 
-uint32_t bmp180_read_uncompensated_pressure(void)
+static void start_pressure_conversion(void)
 {
-    bmp180_write(BMP180_CONTROL, BMP180_READ_PRESSURE_CMD + (oversampling << 6));
-
-    uint8_t wait_time_ms = 2 + (3 << oversampling);
-    vTaskDelay(wait_time_ms / portTICK_RATE_MS);
-
-    uint8_t reg = BMP180_DATA_TO_READ;
-    uint8_t buff[3] = {0};
-    uint32_t data = 0;
+    conversion_oversampling = oversampling;
+    start_conversion(BMP180_READ_PRESSURE_CMD + (conversion_oversampling << 6),
+        pressure_conversion_ms(conversion_oversampling));
+}
 
-    int rc = twi_writeTo(BMP180_ADDRESS, &reg, 1, true);
-    if (rc == 0) {
-        rc = twi_readFrom(BMP180_ADDRESS, buff, 3, true);
-        if (rc == 0) {
-            data = (uint32_t) buff[0]<<16 | buff[1]<<8 | buff[2];
-            data >>= (8 - oversampling);
-        }
-    }
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Read [%02x] failed rc=%d", reg, rc);
-    }
-    return data;
+uint32_t bmp180_read_uncompensated_pressure(void)
+{
+    start_pressure_conversion();
+    wait_for_conversion();
+    return read_uncompensated_pressure_result();
 }
 
-uint32_t bmp180_read_pressure(void)
+static inline uint32_t compensate_pressure(const bmp180_calibration* c, uint32_t up, int32_t b5, uint8_t oss)
 {
-    int32_t up, b3, b5, b6, x1, x2, x3, p;
+    int32_t b3, b6, x1, x2, x3, p;
     uint32_t b4, b7;
 
-    b5 = calculate_b5();
     b6 = b5 - 4000;
 
-    x1 = (b2 * (b6 * b6) >> 12) >> 11;
-    x2 = (ac2 * b6) >> 11;
+    x1 = (c->b2 * (b6 * b6) >> 12) >> 11;
+    x2 = (c->ac2 * b6) >> 11;
     x3 = x1 + x2;
-    b3 = (((((int32_t)ac1) * 4 + x3) << oversampling) + 2) >> 2;
+    b3 = (((((int32_t)c->ac1) * 4 + x3) << oss) + 2) >> 2;
 
-    x1 = (ac3 * b6) >> 13;
-    x2 = (b1 * ((b6 * b6) >> 12)) >> 16;
+    x1 = (c->ac3 * b6) >> 13;
+    x2 = (c->b1 * ((b6 * b6) >> 12)) >> 16;
     x3 = ((x1 + x2) + 2) >> 2;
-    b4 = (ac4 * (uint32_t)(x3 + 32768)) >> 15;
+    b4 = (c->ac4 * (uint32_t)(x3 + 32768)) >> 15;
 
-    up = bmp180_read_uncompensated_pressure();
-    b7 = ((uint32_t)(up - b3) * (50000 >> oversampling));
+    b7 = ((uint32_t)(up - b3) * (50000 >> oss));
     if (b7 < 0x80000000) {
         p = (b7 << 1) / b4;
     } else {
@@ -175,12 +299,229 @@ uint32_t bmp180_read_pressure(void)
     return p;
 }
 
+uint32_t bmp180_read_pressure(void)
+{
+    int32_t b5 = calculate_b5();
+    return compensate_pressure(&calib, bmp180_read_uncompensated_pressure(), b5, conversion_oversampling);
+}
+
 float bmp180_read_altitude(unsigned long reference_pressure)
 {
     uint32_t absolute_pressure = bmp180_read_pressure();
-    return 44330 * (1.0 - powf(absolute_pressure / (float) reference_pressure, 0.190295));
+    return pressure_sensor_altitude(absolute_pressure, reference_pressure);
 }
 
+void bmp180_set_temperature_reuse(unsigned int reuse_count)
+{
+    b5_reuse_count = reuse_count;
+    if (b5_reads_left > reuse_count) {
+        b5_reads_left = reuse_count;
+    }
+}
+
+esp_err_t bmp180_set_oversampling(uint8_t mode)
+{
+    if (mode > BMP180_ULTRA_HIGH_RES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // takes effect with the next pressure conversion
+    oversampling = mode;
+    return ESP_OK;
+}
+
+uint8_t bmp180_get_oversampling(void)
+{
+    return oversampling;
+}
+
+void bmp180_set_conversion_polling(bool enable)
+{
+    conversion_polling = enable;
+}
+
+void bmp180_get_conversion_stats(bmp180_conversion_stats* stats)
+{
+    *stats = conversion_stats;
+}
+
+void bmp180_reset_conversion_stats(void)
+{
+    memset(&conversion_stats, 0, sizeof(conversion_stats));
+}
+
+esp_err_t bmp180_start_pressure(void)
+{
+    read_failed = false;
+    start_pressure_conversion();
+    state = read_failed ? BMP180_STATE_FAILED : BMP180_STATE_PRESSURE;
+    return read_failed ? ESP_ERR_BMP180_READ_FAILED : ESP_OK;
+}
+
+esp_err_t bmp180_start_sample(void)
+{
+    /* Temperature changes slowly comparing to pressure,
+       so take a new temperature conversion only
+       once every 'b5_reuse_count + 1' pressure reads
+     */
+    if (b5_reads_left > 0) {
+        b5_reads_left--;
+        return bmp180_start_pressure();
+    }
+
+    read_failed = false;
+    start_conversion(BMP180_READ_TEMP_CMD, BMP180_TEMP_CONVERSION_MS);
+    state = read_failed ? BMP180_STATE_FAILED : BMP180_STATE_TEMPERATURE;
+    return read_failed ? ESP_ERR_BMP180_READ_FAILED : ESP_OK;
+}
+
+bool bmp180_poll(void)
+{
+    switch (state) {
+    case BMP180_STATE_TEMPERATURE:
+        if (conversion_complete() == false) {
+            break;
+        }
+        ut_cached = bmp180_read_int16(BMP180_DATA_TO_READ);
+        if (read_failed) {
+            state = BMP180_STATE_FAILED;
+            break;
+        }
+        b5_reads_left = b5_reuse_count;
+        bmp180_start_pressure();
+        break;
+    case BMP180_STATE_PRESSURE:
+        if (conversion_complete() == false) {
+            break;
+        }
+        up_collected = read_uncompensated_pressure_result();
+        state = read_failed ? BMP180_STATE_FAILED : BMP180_STATE_READY;
+        break;
+    default:
+        break;
+    }
+    return state == BMP180_STATE_READY || state == BMP180_STATE_FAILED;
+}
+
+esp_err_t bmp180_collect_raw(bmp180_raw_data* raw)
+{
+    if (state == BMP180_STATE_IDLE) {
+        return ESP_ERR_BMP180_NOT_STARTED;
+    }
+    while (bmp180_poll() == false) {
+        vTaskDelay(1);
+    }
+    if (state == BMP180_STATE_FAILED) {
+        // do not trust cached temperature after a failed transaction
+        b5_reads_left = 0;
+        state = BMP180_STATE_IDLE;
+        return ESP_ERR_BMP180_READ_FAILED;
+    }
+    state = BMP180_STATE_IDLE;
+
+    raw->ut = ut_cached;
+    raw->up = up_collected;
+    raw->oversampling = conversion_oversampling;
+    return ESP_OK;
+}
+
+esp_err_t bmp180_collect(unsigned long reference_pressure, bmp180_data* sample)
+{
+    bmp180_raw_data raw;
+
+    esp_err_t err = bmp180_collect_raw(&raw);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int32_t b5 = compensate_b5(&calib, raw.ut);
+    sample->pressure = compensate_pressure(&calib, raw.up, b5, raw.oversampling);
+    sample->temperature = compensate_temperature(b5);
+    sample->altitude = pressure_sensor_altitude(sample->pressure, reference_pressure);
+    return ESP_OK;
+}
+
+void bmp180_compensate_batch(const bmp180_calibration* calibration, const bmp180_raw_batch* raw, bmp180_data* out, size_t n)
+{
+    // local copy of calibration so compiler can keep it in registers
+    const bmp180_calibration c = *calibration;
+    const int16_t* restrict ut = raw->ut;
+    const uint32_t* restrict up = raw->up;
+    const unsigned long* restrict reference_pressure = raw->reference_pressure;
+    const uint8_t oss = raw->oversampling;
+
+    for (size_t i = 0; i < n; i++) {
+        int32_t b5 = compensate_b5(&c, ut[i]);
+        out[i].pressure = compensate_pressure(&c, up[i], b5, oss);
+        out[i].temperature = compensate_temperature(b5);
+    }
+    if (reference_pressure != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            out[i].altitude = pressure_sensor_altitude(out[i].pressure, reference_pressure[i]);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            out[i].altitude = 0.0;
+        }
+    }
+}
+
+esp_err_t bmp180_read_sample(unsigned long reference_pressure, bmp180_data* sample)
+{
+    esp_err_t err = bmp180_start_sample();
+    if (err != ESP_OK) {
+        b5_reads_left = 0;
+        state = BMP180_STATE_IDLE;
+        return err;
+    }
+    return bmp180_collect(reference_pressure, sample);
+}
+
+
+static uint32_t calibration_checksum(void)
+{
+    return crc32_le(0, (const uint8_t*) &calib, sizeof(calib));
+}
+
+// Get 16 bit calibration parameter at register 'reg' out of calibration data block
+#define calib_int16(buff, reg) ((int16_t) ((buff)[(reg) - BMP180_CAL_AC1] << 8 | (buff)[(reg) - BMP180_CAL_AC1 + 1]))
+
+static esp_err_t read_calibration(void)
+{
+    uint8_t buff[BMP180_CAL_SIZE];
+
+    if (bmp180_read_bytes(BMP180_CAL_AC1, buff, BMP180_CAL_SIZE) != 0) {
+        bmp180_invalidate_calibration();
+        return ESP_ERR_BMP180_READ_FAILED;
+    }
+    calib.ac1 = calib_int16(buff, BMP180_CAL_AC1);
+    calib.ac2 = calib_int16(buff, BMP180_CAL_AC2);
+    calib.ac3 = calib_int16(buff, BMP180_CAL_AC3);
+    calib.ac4 = (uint16_t) calib_int16(buff, BMP180_CAL_AC4);
+    calib.ac5 = (uint16_t) calib_int16(buff, BMP180_CAL_AC5);
+    calib.ac6 = (uint16_t) calib_int16(buff, BMP180_CAL_AC6);
+    calib.b1 = calib_int16(buff, BMP180_CAL_B1);
+    calib.b2 = calib_int16(buff, BMP180_CAL_B2);
+    calib.mb = calib_int16(buff, BMP180_CAL_MB);
+    calib.mc = calib_int16(buff, BMP180_CAL_MC);
+    calib.md = calib_int16(buff, BMP180_CAL_MD);
+    calib_checksum = calibration_checksum();
+    return ESP_OK;
+}
+
+void bmp180_invalidate_calibration(void)
+{
+    calib_checksum = ~calibration_checksum();
+}
+
+void bmp180_get_calibration(bmp180_calibration* calibration)
+{
+    *calibration = calib;
+}
+
+bool bmp180_calibration_valid(void)
+{
+    return calib_checksum == calibration_checksum();
+}
 
 esp_err_t bmp180_init(int pin_sda, int pin_scl)
 {
@@ -194,25 +535,90 @@ esp_err_t bmp180_init(int pin_sda, int pin_scl)
         return ESP_ERR_BMP180_NOT_DETECTED;
     }
 
-    twi_init(pin_sda, pin_scl);
+    if (bmp180_device == NULL) {
+        bmp180_device = twi_bus_add_device(pin_sda, pin_scl, BMP180_ADDRESS, BMP180_BUS_PRIORITY);
+        if (bmp180_device == NULL) {
+            return ESP_ERR_BMP180_NOT_DETECTED;
+        }
+    }
 
     uint8_t reg = 0x00;
-    if (twi_writeTo(BMP180_ADDRESS, &reg, 1, true) == 0) {
+    if (twi_device_write(bmp180_device, &reg, 1) == 0) {
         ESP_LOGD(TAG, "Sensor found at 0x%02x", BMP180_ADDRESS);
-        ac1 = bmp180_read_int16(BMP180_CAL_AC1);
-        ac2 = bmp180_read_int16(BMP180_CAL_AC2);
-        ac3 = bmp180_read_int16(BMP180_CAL_AC3);
-        ac4 = (uint16_t) bmp180_read_int16(BMP180_CAL_AC4);
-        ac5 = (uint16_t) bmp180_read_int16(BMP180_CAL_AC5);
-        ac6 = (uint16_t) bmp180_read_int16(BMP180_CAL_AC6);
-        b1 = bmp180_read_int16(BMP180_CAL_B1);
-        b2 = bmp180_read_int16(BMP180_CAL_B2);
-        mb = bmp180_read_int16(BMP180_CAL_MB);
-        mc = bmp180_read_int16(BMP180_CAL_MC);
-        md = bmp180_read_int16(BMP180_CAL_MD);
-        return ESP_OK;
+        /* On wake up from deep sleep reuse calibration retained in RTC memory,
+           unless it has been corrupted. Contents of RTC memory
+           is not valid after power on or any other reset, so read it again.
+         */
+        if (rtc_get_reset_reason(0) == DEEPSLEEP_RESET) {
+            if (calib_checksum == calibration_checksum()) {
+                ESP_LOGD(TAG, "Calibration restored from RTC memory");
+                return ESP_OK;
+            }
+            ESP_LOGW(TAG, "Calibration checksum mismatch, reading it again");
+        }
+        return read_calibration();
     } else {
         ESP_LOGE(TAG, "Sensor not found at 0x%02x", BMP180_ADDRESS);
         return ESP_ERR_BMP180_NOT_DETECTED;
     }
 }
+
+
+/* BMP180 as implementation of pressure_sensor_driver
+ */
+#define BMP180_SENSOR_TEMPERATURE_REUSE 3
+
+static esp_err_t bmp180_sensor_init(int pin_sda, int pin_scl)
+{
+    esp_err_t err = bmp180_init(pin_sda, pin_scl);
+    if (err == ESP_OK) {
+        bmp180_set_temperature_reuse(BMP180_SENSOR_TEMPERATURE_REUSE);
+        bmp180_set_conversion_polling(true);
+    }
+    return err;
+}
+
+static esp_err_t bmp180_sensor_set_resolution(uint8_t level)
+{
+    // resolution levels map directly to BMP180 oversampling modes
+    return bmp180_set_oversampling(level);
+}
+
+static esp_err_t bmp180_sensor_read_sample(pressure_sensor_data* sample)
+{
+    bmp180_raw_data raw;
+    bmp180_data data;
+
+    esp_err_t err = bmp180_collect_raw(&raw);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bmp180_raw_batch batch = {
+        .ut = &raw.ut, .up = &raw.up,
+        .reference_pressure = NULL, .oversampling = raw.oversampling
+    };
+    bmp180_compensate_batch(&calib, &batch, &data, 1);
+    sample->pressure = data.pressure;
+    sample->temperature = data.temperature;
+    return ESP_OK;
+}
+
+static void bmp180_sensor_power_down(void)
+{
+    // BMP180 goes to standby on its own after each conversion
+    ESP_LOGD(TAG, "Conversions %lu took %lu ms out of %lu ms budgeted, timeouts %lu",
+        conversion_stats.conversions, conversion_stats.time_actual_ms,
+        conversion_stats.time_budget_ms, conversion_stats.timeouts);
+    twi_bus_remove_device(bmp180_device);
+    bmp180_device = NULL;
+}
+
+const pressure_sensor_driver bmp180_pressure_sensor = {
+    .name = "BMP180",
+    .init = bmp180_sensor_init,
+    .set_resolution = bmp180_sensor_set_resolution,
+    .start = bmp180_start_sample,
+    .poll = bmp180_poll,
+    .read_sample = bmp180_sensor_read_sample,
+    .power_down = bmp180_sensor_power_down
+};
@@ -12,21 +12,215 @@
 #ifndef BMP180_H
 #define BMP180_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Pressure measurement oversampling modes
+#define BMP180_ULTRA_LOW_POWER  0  // 1 sample, 4.5 ms conversion time
+#define BMP180_STANDARD         1  // 2 samples, 7.5 ms
+#define BMP180_HIGH_RES         2  // 4 samples, 13.5 ms
+#define BMP180_ULTRA_HIGH_RES   3  // 8 samples, 25.5 ms
+
 #define ESP_ERR_BMP180_BASE            0x30000
 #define ESP_ERR_TOO_SLOW_TICK_RATE     (ESP_ERR_BMP180_BASE + 1)
 #define ESP_ERR_BMP180_NOT_DETECTED    (ESP_ERR_BMP180_BASE + 2)
+#define ESP_ERR_BMP180_READ_FAILED     (ESP_ERR_BMP180_BASE + 3)
+#define ESP_ERR_BMP180_NOT_STARTED     (ESP_ERR_BMP180_BASE + 4)
+
+typedef struct {
+    int16_t ac1;
+    int16_t ac2;
+    int16_t ac3;
+    uint16_t ac4;
+    uint16_t ac5;
+    uint16_t ac6;
+    int16_t b1;
+    int16_t b2;
+    int16_t mb;
+    int16_t mc;
+    int16_t md;
+} bmp180_calibration;
+
+typedef struct {
+    uint32_t pressure;  /*!< Compensated pressure [Pa] */
+    float temperature;  /*!< Compensated temperature [deg C] */
+    float altitude;  /*!< Altitude [meters] calculated against reference pressure */
+} bmp180_data;
+
+typedef struct {
+    int16_t ut;  /*!< Uncompensated temperature */
+    uint32_t up;  /*!< Uncompensated pressure */
+    uint8_t oversampling;  /*!< Oversampling mode pressure has been measured with */
+} bmp180_raw_data;
+
+/* Raw readings to compensate with bmp180_compensate_batch()
+   organized as structure of arrays
+ */
+typedef struct {
+    const int16_t* ut;  /*!< Uncompensated temperature readings */
+    const uint32_t* up;  /*!< Uncompensated pressure readings */
+    const unsigned long* reference_pressure;  /*!< Reference pressure [Pa] for each reading, NULL to skip altitude */
+    uint8_t oversampling;  /*!< Oversampling mode all pressure readings have been measured with */
+} bmp180_raw_batch;
+
+typedef struct {
+    unsigned long conversions;  /*!< Number of conversions completed with polling */
+    unsigned long timeouts;  /*!< Number of conversions that did not complete in time */
+    unsigned long time_actual_ms;  /*!< Total time [ms] conversions actually took */
+    unsigned long time_actual_max_ms;  /*!< The longest conversion time [ms] */
+    unsigned long time_budget_ms;  /*!< Total time [ms] budgeted as per datasheet worst case */
+} bmp180_conversion_stats;
 
 esp_err_t bmp180_init(int pin_sda, int pin_scl);
+
+/**
+@brief Force reading of calibration from sensor's EEPROM on next bmp180_init()
+
+By default calibration read on power on is retained in RTC memory
+and reused when waking up from deep sleep.
+*/
+void bmp180_invalidate_calibration(void);
+void bmp180_get_calibration(bmp180_calibration* calibration);
+
+/**
+@brief Check if calibration retained in RTC memory is intact
+
+It may be used to compensate raw samples taken without bmp180_init(),
+e.g. by deep sleep wake stub, even if sensor does not respond now.
+*/
+bool bmp180_calibration_valid(void);
 float bmp180_read_temperature(void);
 uint32_t bmp180_read_pressure(void);
 float bmp180_read_altitude(unsigned long reference_pressure);
 
+/**
+@brief Read pressure, temperature and altitude in one go
+
+Takes single temperature and single pressure conversion,
+instead of separate conversions done by bmp180_read_temperature(),
+bmp180_read_pressure() and bmp180_read_altitude().
+Temperature conversion may be skipped altogether,
+if configured with bmp180_set_temperature_reuse().
+
+@param reference_pressure pressure [Pa] to calculate altitude against
+@param sample pointer to structure to save the results
+
+@return
+    - ESP_OK - sample read
+    - ESP_ERR_BMP180_READ_FAILED - communication with sensor failed
+*/
+esp_err_t bmp180_read_sample(unsigned long reference_pressure, bmp180_data* sample);
+
+/**
+@brief Start measurement without waiting for the result
+
+Starts temperature conversion (unless reused, see bmp180_set_temperature_reuse())
+followed by pressure conversion. Sensor converts on its own
+while the calling task is free to do other things.
+Call bmp180_poll() from time to time to advance measurement
+from temperature to pressure conversion and bmp180_collect() to get the result.
+
+@return
+    - ESP_OK - measurement started
+    - ESP_ERR_BMP180_READ_FAILED - communication with sensor failed
+*/
+esp_err_t bmp180_start_sample(void);
+
+/**
+@brief Start pressure conversion reusing previously measured temperature
+*/
+esp_err_t bmp180_start_pressure(void);
+
+/**
+@brief Advance measurement without blocking
+
+@return
+    - true - measurement is complete (or failed) and ready to collect
+    - false - conversion is still in progress
+*/
+bool bmp180_poll(void);
+
+/**
+@brief Collect result of measurement started with bmp180_start_sample()
+
+Blocks until conversions in progress are complete.
+
+@param reference_pressure pressure [Pa] to calculate altitude against
+@param sample pointer to structure to save the results
+
+@return
+    - ESP_OK - sample read
+    - ESP_ERR_BMP180_READ_FAILED - communication with sensor failed
+    - ESP_ERR_BMP180_NOT_STARTED - measurement has not been started
+*/
+esp_err_t bmp180_collect(unsigned long reference_pressure, bmp180_data* sample);
+
+/**
+@brief Collect uncompensated result of measurement started with bmp180_start_sample()
+
+Same as bmp180_collect() but without compensation,
+so raw readings may be saved and compensated later in bulk.
+*/
+esp_err_t bmp180_collect_raw(bmp180_raw_data* raw);
+
+/**
+@brief Compensate raw readings in bulk
+
+Pure function of calibration and raw readings,
+so it may be run on the host against logged raw data as well.
+
+@param calibration calibration of the sensor readings have been taken with
+@param raw arrays of 'n' raw readings
+@param out array to save 'n' compensated samples
+@param n number of readings
+*/
+void bmp180_compensate_batch(const bmp180_calibration* calibration, const bmp180_raw_batch* raw, bmp180_data* out, size_t n);
+
+/**
+@brief Reuse temperature measurement across several samples
+
+@param reuse_count number of bmp180_read_sample() calls
+                   that reuse the last temperature conversion,
+                   0 - take temperature conversion for each sample
+*/
+void bmp180_set_temperature_reuse(unsigned int reuse_count);
+
+/**
+@brief Select oversampling mode of pressure measurement
+
+Higher oversampling reduces noise at the cost
+of longer conversion time and higher current consumption.
+New mode takes effect with the next pressure conversion.
+Default mode is BMP180_ULTRA_HIGH_RES.
+
+@param mode BMP180_ULTRA_LOW_POWER, BMP180_STANDARD, BMP180_HIGH_RES or BMP180_ULTRA_HIGH_RES
+
+@return
+    - ESP_OK - mode set
+    - ESP_ERR_INVALID_ARG - unknown mode
+*/
+esp_err_t bmp180_set_oversampling(uint8_t mode);
+uint8_t bmp180_get_oversampling(void);
+
+/**
+@brief Poll sensor for end of conversion
+
+Instead of waiting datasheet worst case time for conversion to complete,
+poll Sco bit of control register and read the result as soon as it is ready.
+Polling is bounded by worst case conversion time plus a small margin.
+
+@param enable true - poll for end of conversion, false - wait worst case time
+*/
+void bmp180_set_conversion_polling(bool enable);
+void bmp180_get_conversion_stats(bmp180_conversion_stats* stats);
+void bmp180_reset_conversion_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,342 @@
+/*
+ bmp280.c - BMP280 / BME280 pressure sensor driver for ESP32
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_log.h"
+
+#include "bmp280.h"
+#include "pressure_sensor.h"
+#include "twi_bus.h"
+
+static const char* TAG = "BMP280";
+
+#define BMP280_ADDRESS 0x76  // I2C address of BMP280 with SDO pulled low
+#define BMP280_BUS_PRIORITY 6  // Above application tasks (5), so pressure reads are not held up by other devices on the bus
+
+#define BMP280_CHIP_ID_BMP280   0x58
+#define BMP280_CHIP_ID_BME280   0x60
+
+#define BMP280_CALIB            0x88  // Calibration data, 24 bytes
+#define BMP280_CALIB_SIZE       24
+#define BMP280_CHIP_ID          0xD0  // Chip id register
+#define BMP280_CTRL_HUM         0xF2  // Humidity control register (BME280 only)
+#define BMP280_STATUS           0xF3  // Status register
+#define BMP280_CTRL_MEAS        0xF4  // Oversampling and mode control register
+#define BMP280_CONFIG           0xF5  // Standby time and IIR filter register
+#define BMP280_DATA             0xF7  // Pressure and temperature, 6 bytes
+
+#define BMP280_STATUS_MEASURING 0x08  // Set while conversion is running
+#define BMP280_MODE_FORCED      0x01
+
+static twi_device* bmp280_device = NULL;
+static bmp280_calibration calib;
+static uint8_t chip_id;
+static uint8_t osrs_t = BMP280_OVERSAMPLING_X2;
+static uint8_t osrs_p = BMP280_OVERSAMPLING_X16;
+/* Samples are taken in forced mode, up to a minute apart,
+   so IIR filter would spread real altitude change over several samples
+ */
+static uint8_t filter = BMP280_FILTER_OFF;
+
+// Measurement started and not collected yet
+static bool started = false;
+// Measurement in progress
+static bool measuring = false;
+static bool read_failed = false;
+static TickType_t measurement_start;
+static uint8_t measurement_time_ms;
+
+
+static uint8_t bmp280_read_bytes(uint8_t reg, uint8_t* buff, unsigned int len)
+{
+    int rc = twi_device_write_read(bmp280_device, &reg, 1, buff, len);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Read [%02x] failed rc=%d", reg, rc);
+        read_failed = true;
+    }
+    return rc;
+}
+
+static uint8_t bmp280_write(uint8_t reg, uint8_t data)
+{
+    uint8_t buf[] = {reg, data};
+
+    uint8_t ret = twi_device_write(bmp280_device, buf, 2);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Write [%02x]=%02x failed", reg, data);
+        read_failed = true;
+    }
+    return ret;
+}
+
+// Number of samples taken for oversampling setting
+static uint8_t oversampling_samples(uint8_t osrs)
+{
+    return osrs == BMP280_OVERSAMPLING_SKIP ? 0 : 1 << (osrs - 1);
+}
+
+/* Maximum measurement time [ms] as per datasheet
+   1.25 + 2.3 * T samples + 2.3 * P samples + 0.575
+ */
+static uint8_t max_measurement_time_ms(void)
+{
+    unsigned int time_us = 1250 + 2300 * oversampling_samples(osrs_t);
+    if (osrs_p != BMP280_OVERSAMPLING_SKIP) {
+        time_us += 2300 * oversampling_samples(osrs_p) + 575;
+    }
+    return (time_us + 999) / 1000;
+}
+
+/* Compensation as per BMP280 datasheet,
+   temperature with 32 bit and pressure with 64 bit integer arithmetic
+ */
+static int32_t compensate_t_fine(int32_t adc_t)
+{
+    int32_t var1, var2;
+
+    var1 = ((((adc_t >> 3) - ((int32_t) calib.dig_t1 << 1))) * ((int32_t) calib.dig_t2)) >> 11;
+    var2 = (((((adc_t >> 4) - ((int32_t) calib.dig_t1)) * ((adc_t >> 4) - ((int32_t) calib.dig_t1))) >> 12) *
+            ((int32_t) calib.dig_t3)) >> 14;
+    return var1 + var2;
+}
+
+static uint32_t compensate_pressure(int32_t adc_p, int32_t t_fine)
+{
+    int64_t var1, var2, p;
+
+    var1 = ((int64_t) t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t) calib.dig_p6;
+    var2 = var2 + ((var1 * (int64_t) calib.dig_p5) << 17);
+    var2 = var2 + (((int64_t) calib.dig_p4) << 35);
+    var1 = ((var1 * var1 * (int64_t) calib.dig_p3) >> 8) + ((var1 * (int64_t) calib.dig_p2) << 12);
+    var1 = (((((int64_t) 1) << 47) + var1)) * ((int64_t) calib.dig_p1) >> 33;
+    if (var1 == 0) {
+        // avoid exception caused by division by zero
+        return 0;
+    }
+    p = 1048576 - adc_p;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t) calib.dig_p9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t) calib.dig_p8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t) calib.dig_p7) << 4);
+    // p is in Q24.8 format
+    return (uint32_t) ((p + 128) >> 8);
+}
+
+static esp_err_t read_calibration(void)
+{
+    uint8_t buff[BMP280_CALIB_SIZE];
+
+    if (bmp280_read_bytes(BMP280_CALIB, buff, BMP280_CALIB_SIZE) != 0) {
+        return ESP_ERR_BMP280_READ_FAILED;
+    }
+    // calibration words are little endian
+    uint16_t words[BMP280_CALIB_SIZE / 2];
+    for (int i = 0; i < BMP280_CALIB_SIZE / 2; i++) {
+        words[i] = buff[2 * i] | buff[2 * i + 1] << 8;
+    }
+    calib.dig_t1 = words[0];
+    calib.dig_t2 = (int16_t) words[1];
+    calib.dig_t3 = (int16_t) words[2];
+    calib.dig_p1 = words[3];
+    calib.dig_p2 = (int16_t) words[4];
+    calib.dig_p3 = (int16_t) words[5];
+    calib.dig_p4 = (int16_t) words[6];
+    calib.dig_p5 = (int16_t) words[7];
+    calib.dig_p6 = (int16_t) words[8];
+    calib.dig_p7 = (int16_t) words[9];
+    calib.dig_p8 = (int16_t) words[10];
+    calib.dig_p9 = (int16_t) words[11];
+    return ESP_OK;
+}
+
+esp_err_t bmp280_set_oversampling(uint8_t temperature_osrs, uint8_t pressure_osrs)
+{
+    if (temperature_osrs > BMP280_OVERSAMPLING_X16 || pressure_osrs > BMP280_OVERSAMPLING_X16) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // takes effect with the next measurement
+    osrs_t = temperature_osrs;
+    osrs_p = pressure_osrs;
+    return ESP_OK;
+}
+
+esp_err_t bmp280_set_filter(uint8_t filter_coefficient)
+{
+    if (filter_coefficient > BMP280_FILTER_16) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    filter = filter_coefficient;
+
+    uint8_t config = 0;
+    read_failed = false;
+    bmp280_read_bytes(BMP280_CONFIG, &config, 1);
+    // changing configuration resets filter history, so avoid it if possible
+    if (read_failed == false && ((config >> 2) & 0x07) != filter) {
+        ESP_LOGD(TAG, "Setting IIR filter %d", filter);
+        bmp280_write(BMP280_CONFIG, (config & ~(0x07 << 2)) | (filter << 2));
+    }
+    return read_failed ? ESP_ERR_BMP280_READ_FAILED : ESP_OK;
+}
+
+esp_err_t bmp280_start(void)
+{
+    read_failed = false;
+    if (chip_id == BMP280_CHIP_ID_BME280) {
+        // humidity is not measured, but ctrl_hum has to be written before ctrl_meas
+        bmp280_write(BMP280_CTRL_HUM, BMP280_OVERSAMPLING_SKIP);
+    }
+    bmp280_write(BMP280_CTRL_MEAS, osrs_t << 5 | osrs_p << 2 | BMP280_MODE_FORCED);
+    measurement_start = xTaskGetTickCount();
+    measurement_time_ms = max_measurement_time_ms();
+    measuring = (read_failed == false);
+    started = measuring;
+    return read_failed ? ESP_ERR_BMP280_READ_FAILED : ESP_OK;
+}
+
+bool bmp280_poll(void)
+{
+    if (measuring == false) {
+        return true;
+    }
+    TickType_t elapsed = xTaskGetTickCount() - measurement_start;
+    if (elapsed * portTICK_RATE_MS >= measurement_time_ms) {
+        measuring = false;
+    } else if (elapsed > 0) {
+        uint8_t status = BMP280_STATUS_MEASURING;
+        bmp280_read_bytes(BMP280_STATUS, &status, 1);
+        if ((status & BMP280_STATUS_MEASURING) == 0) {
+            measuring = false;
+        }
+    }
+    return measuring == false;
+}
+
+esp_err_t bmp280_collect(bmp280_data* sample)
+{
+    uint8_t buff[6];
+
+    if (chip_id == 0 || started == false) {
+        // data registers would hold result of the previous measurement
+        return ESP_ERR_BMP280_NOT_STARTED;
+    }
+    while (bmp280_poll() == false) {
+        vTaskDelay(1);
+    }
+    started = false;
+    if (read_failed) {
+        return ESP_ERR_BMP280_READ_FAILED;
+    }
+    // burst read of both pressure and temperature
+    if (bmp280_read_bytes(BMP280_DATA, buff, sizeof(buff)) != 0) {
+        return ESP_ERR_BMP280_READ_FAILED;
+    }
+    int32_t adc_p = (int32_t) buff[0] << 12 | buff[1] << 4 | buff[2] >> 4;
+    int32_t adc_t = (int32_t) buff[3] << 12 | buff[4] << 4 | buff[5] >> 4;
+
+    int32_t t_fine = compensate_t_fine(adc_t);
+    sample->temperature = ((t_fine * 5 + 128) >> 8) / 100.0;
+    sample->pressure = compensate_pressure(adc_p, t_fine);
+    return ESP_OK;
+}
+
+void bmp280_sleep(void)
+{
+    // sensor returns to sleep mode after forced measurement on its own,
+    // so just make sure it does not stay in normal mode
+    uint8_t ctrl_meas = 0;
+    if (bmp280_read_bytes(BMP280_CTRL_MEAS, &ctrl_meas, 1) == 0 && (ctrl_meas & 0x03) != 0) {
+        bmp280_write(BMP280_CTRL_MEAS, ctrl_meas & ~0x03);
+    }
+}
+
+esp_err_t bmp280_init(int pin_sda, int pin_scl)
+{
+    if (bmp280_device == NULL) {
+        bmp280_device = twi_bus_add_device(pin_sda, pin_scl, BMP280_ADDRESS, BMP280_BUS_PRIORITY);
+        if (bmp280_device == NULL) {
+            return ESP_ERR_BMP280_NOT_DETECTED;
+        }
+    }
+
+    read_failed = false;
+    chip_id = 0;
+    uint8_t id = 0;
+    if (bmp280_read_bytes(BMP280_CHIP_ID, &id, 1) != 0 ||
+            (id != BMP280_CHIP_ID_BMP280 && id != BMP280_CHIP_ID_BME280)) {
+        ESP_LOGE(TAG, "Sensor not found at 0x%02x (id 0x%02x)", BMP280_ADDRESS, id);
+        return ESP_ERR_BMP280_NOT_DETECTED;
+    }
+    ESP_LOGD(TAG, "Sensor %s found at 0x%02x", id == BMP280_CHIP_ID_BME280 ? "BME280" : "BMP280", BMP280_ADDRESS);
+
+    esp_err_t err = read_calibration();
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = bmp280_set_filter(filter);
+    if (err != ESP_OK) {
+        return err;
+    }
+    chip_id = id;
+    return ESP_OK;
+}
+
+
+/* BMP280 as implementation of pressure_sensor_driver
+ */
+static esp_err_t bmp280_sensor_set_resolution(uint8_t level)
+{
+    // recommended settings from the datasheet,
+    // from 'ultra low power' to 'ultra high resolution'
+    static const uint8_t pressure_osrs[] = {
+        BMP280_OVERSAMPLING_X1, BMP280_OVERSAMPLING_X2,
+        BMP280_OVERSAMPLING_X4, BMP280_OVERSAMPLING_X16
+    };
+    if (level > PRESSURE_SENSOR_ULTRA_HIGH_RES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t temperature_osrs = (level == PRESSURE_SENSOR_ULTRA_HIGH_RES) ?
+        BMP280_OVERSAMPLING_X2 : BMP280_OVERSAMPLING_X1;
+    return bmp280_set_oversampling(temperature_osrs, pressure_osrs[level]);
+}
+
+static esp_err_t bmp280_sensor_read_sample(pressure_sensor_data* sample)
+{
+    bmp280_data data;
+
+    esp_err_t err = bmp280_collect(&data);
+    if (err == ESP_OK) {
+        sample->pressure = data.pressure;
+        sample->temperature = data.temperature;
+    }
+    return err;
+}
+
+static void bmp280_sensor_power_down(void)
+{
+    if (bmp280_device == NULL) {
+        return;
+    }
+    bmp280_sleep();
+    twi_bus_remove_device(bmp280_device);
+    bmp280_device = NULL;
+}
+
+const pressure_sensor_driver bmp280_pressure_sensor = {
+    .name = "BMP280",
+    .init = bmp280_init,
+    .set_resolution = bmp280_sensor_set_resolution,
+    .start = bmp280_start,
+    .poll = bmp280_poll,
+    .read_sample = bmp280_sensor_read_sample,
+    .power_down = bmp280_sensor_power_down
+};
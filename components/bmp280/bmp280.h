@@ -0,0 +1,112 @@
+/*
+ bmp280.h - BMP280 / BME280 pressure sensor driver for ESP32
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#ifndef BMP280_H
+#define BMP280_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_BMP280_BASE            0x70000
+#define ESP_ERR_BMP280_NOT_DETECTED    (ESP_ERR_BMP280_BASE + 1)
+#define ESP_ERR_BMP280_READ_FAILED     (ESP_ERR_BMP280_BASE + 2)
+#define ESP_ERR_BMP280_NOT_STARTED     (ESP_ERR_BMP280_BASE + 3)
+
+// Oversampling settings of osrs_t and osrs_p fields
+#define BMP280_OVERSAMPLING_SKIP  0
+#define BMP280_OVERSAMPLING_X1    1
+#define BMP280_OVERSAMPLING_X2    2
+#define BMP280_OVERSAMPLING_X4    3
+#define BMP280_OVERSAMPLING_X8    4
+#define BMP280_OVERSAMPLING_X16   5
+
+// IIR filter coefficients
+#define BMP280_FILTER_OFF  0
+#define BMP280_FILTER_2    1
+#define BMP280_FILTER_4    2
+#define BMP280_FILTER_8    3
+#define BMP280_FILTER_16   4
+
+typedef struct {
+    uint16_t dig_t1;
+    int16_t dig_t2;
+    int16_t dig_t3;
+    uint16_t dig_p1;
+    int16_t dig_p2;
+    int16_t dig_p3;
+    int16_t dig_p4;
+    int16_t dig_p5;
+    int16_t dig_p6;
+    int16_t dig_p7;
+    int16_t dig_p8;
+    int16_t dig_p9;
+} bmp280_calibration;
+
+typedef struct {
+    uint32_t pressure;  /*!< Compensated pressure [Pa] */
+    float temperature;  /*!< Compensated temperature [deg C] */
+} bmp280_data;
+
+/**
+@brief Initialize BMP280 or BME280 sensor
+
+Reads calibration and configures IIR filter, off by default,
+as samples in forced mode are too far apart to be filtered.
+Filter configuration is written only if it differs from the current one,
+so filter history is retained when waking up from deep sleep.
+
+@return
+    - ESP_OK - sensor initialized
+    - ESP_ERR_BMP280_NOT_DETECTED - no sensor with expected chip id found
+    - ESP_ERR_BMP280_READ_FAILED - communication with sensor failed
+*/
+esp_err_t bmp280_init(int pin_sda, int pin_scl);
+esp_err_t bmp280_set_oversampling(uint8_t osrs_t, uint8_t osrs_p);
+esp_err_t bmp280_set_filter(uint8_t filter);
+
+/**
+@brief Start measurement in forced mode without waiting for the result
+*/
+esp_err_t bmp280_start(void);
+
+/**
+@brief Advance measurement without blocking
+
+@return
+    - true - measurement is complete (or failed) and ready to collect
+    - false - measurement is still in progress
+*/
+bool bmp280_poll(void);
+
+/**
+@brief Collect result of measurement started with bmp280_start()
+
+Blocks until measurement is complete.
+Pressure and temperature are read together in one burst.
+
+@return
+    - ESP_OK - sample collected
+    - ESP_ERR_BMP280_NOT_STARTED - sensor not initialized or measurement not started
+    - ESP_ERR_BMP280_READ_FAILED - communication with sensor failed
+*/
+esp_err_t bmp280_collect(bmp280_data* sample);
+void bmp280_sleep(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BMP280_H
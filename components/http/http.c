@@ -26,6 +26,7 @@
 #include "http.h"
 
 #define RECV_BUFFER_SIZE 64
+#define SOCKET_TIMEOUT_MS 5000  // Time to wait for server to accept or send data
 static const char* TAG = "HTTP";
 
 
@@ -81,6 +82,14 @@ esp_err_t http_client_request(http_client_data *client, const char *web_server,
     }
     ESP_LOGI(TAG, "... allocated socket");
 
+    // stalled server should not keep the radio on indefinitely
+    struct timeval timeout = {
+        .tv_sec = SOCKET_TIMEOUT_MS / 1000,
+        .tv_usec = (SOCKET_TIMEOUT_MS % 1000) * 1000
+    };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
     if (connect(s, res->ai_addr, res->ai_addrlen) != 0) {
         ESP_LOGE(TAG, "... socket connect failed errno=%d", errno);
         close(s);
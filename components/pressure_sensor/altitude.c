@@ -0,0 +1,77 @@
+/*
+ altitude.c - Conversion of pressure into altitude, common to all sensors
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <math.h>
+
+#include "pressure_sensor.h"
+
+/* Conversion of pressure into altitude
+   Altitude = 44330 * (1 - (p/p0)^BAROMETRIC_EXPONENT)
+   Table of 2^BAROMETRIC_TABLE_BITS intervals keeps error
+   of pressure_sensor_altitude() below 0.06 m against powf()
+   for pressure 30 - 110 kPa and reference pressure 90 - 106 kPa
+ */
+#define BAROMETRIC_EXPONENT     0.190295
+#define BAROMETRIC_TABLE_BITS   7
+#define BAROMETRIC_TABLE_SIZE   (1 << BAROMETRIC_TABLE_BITS)
+#define BAROMETRIC_EXP_MIN      -4
+#define BAROMETRIC_EXP_MAX      4
+
+float pressure_sensor_altitude_exact(uint32_t pressure, unsigned long reference_pressure)
+{
+    return 44330 * (1.0 - powf(pressure / (float) reference_pressure, BAROMETRIC_EXPONENT));
+}
+
+/* Table of m^BAROMETRIC_EXPONENT for mantissa m in [1, 2)
+   sampled at BAROMETRIC_TABLE_SIZE equal intervals
+   and 2^(e*BAROMETRIC_EXPONENT) for exponents e of pressure ratio
+   in range BAROMETRIC_EXP_MIN to BAROMETRIC_EXP_MAX
+ */
+static float barometric_mantissa[BAROMETRIC_TABLE_SIZE + 1];
+static float barometric_exponent[BAROMETRIC_EXP_MAX - BAROMETRIC_EXP_MIN + 1];
+static bool barometric_tables_ready = false;
+
+static void barometric_tables_init(void)
+{
+    for (int i = 0; i <= BAROMETRIC_TABLE_SIZE; i++) {
+        barometric_mantissa[i] = powf(1.0 + i / (float) BAROMETRIC_TABLE_SIZE, BAROMETRIC_EXPONENT);
+    }
+    for (int e = BAROMETRIC_EXP_MIN; e <= BAROMETRIC_EXP_MAX; e++) {
+        barometric_exponent[e - BAROMETRIC_EXP_MIN] = powf(2.0, e * BAROMETRIC_EXPONENT);
+    }
+    barometric_tables_ready = true;
+}
+
+float pressure_sensor_altitude(uint32_t pressure, unsigned long reference_pressure)
+{
+    if (barometric_tables_ready == false) {
+        barometric_tables_init();
+    }
+
+    /* Split pressure ratio x = m * 2^e into mantissa and exponent,
+       so x^a = m^a * 2^(e*a), then interpolate m^a from the table
+       and look up 2^(e*a)
+     */
+    union {
+        float f;
+        uint32_t u;
+    } x = { .f = pressure / (float) reference_pressure };
+    int e = (int) ((x.u >> 23) & 0xff) - 127;
+    if (e < BAROMETRIC_EXP_MIN || e > BAROMETRIC_EXP_MAX) {
+        return pressure_sensor_altitude_exact(pressure, reference_pressure);
+    }
+    uint32_t mantissa = x.u & 0x7fffff;
+    uint32_t i = mantissa >> (23 - BAROMETRIC_TABLE_BITS);
+    float fraction = (mantissa & ((1 << (23 - BAROMETRIC_TABLE_BITS)) - 1)) * (1.0 / (1 << (23 - BAROMETRIC_TABLE_BITS)));
+    float m_pow = barometric_mantissa[i] + (barometric_mantissa[i + 1] - barometric_mantissa[i]) * fraction;
+
+    return 44330 * (1.0 - m_pow * barometric_exponent[e - BAROMETRIC_EXP_MIN]);
+}
@@ -0,0 +1,62 @@
+/*
+ pressure_sensor.c - Pressure sensor driver interface
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "esp_log.h"
+
+#include "pressure_sensor.h"
+
+static const char* TAG = "Pressure sensor";
+
+#if CONFIG_PRESSURE_SENSOR_BMP280
+static const pressure_sensor_driver* sensor = &bmp280_pressure_sensor;
+#else
+static const pressure_sensor_driver* sensor = &bmp180_pressure_sensor;
+#endif
+
+esp_err_t pressure_sensor_init(int pin_sda, int pin_scl)
+{
+    ESP_LOGD(TAG, "Using %s", sensor->name);
+    return sensor->init(pin_sda, pin_scl);
+}
+
+esp_err_t pressure_sensor_set_resolution(uint8_t level)
+{
+    return sensor->set_resolution(level);
+}
+
+esp_err_t pressure_sensor_start(void)
+{
+    return sensor->start();
+}
+
+bool pressure_sensor_poll(void)
+{
+    return sensor->poll();
+}
+
+esp_err_t pressure_sensor_read_sample(unsigned long reference_pressure, pressure_sensor_data* sample)
+{
+    esp_err_t err = sensor->read_sample(sample);
+    if (err == ESP_OK) {
+        sample->altitude = pressure_sensor_altitude(sample->pressure, reference_pressure);
+    }
+    return err;
+}
+
+void pressure_sensor_power_down(void)
+{
+    sensor->power_down();
+}
+
+const char* pressure_sensor_name(void)
+{
+    return sensor->name;
+}
@@ -0,0 +1,100 @@
+/*
+ pressure_sensor.h - Pressure sensor driver interface
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef PRESSURE_SENSOR_H
+#define PRESSURE_SENSOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Resolution levels, from the fastest and the most noisy one
+#define PRESSURE_SENSOR_LOW_POWER       0
+#define PRESSURE_SENSOR_STANDARD        1
+#define PRESSURE_SENSOR_HIGH_RES        2
+#define PRESSURE_SENSOR_ULTRA_HIGH_RES  3
+
+typedef struct {
+    uint32_t pressure;  /*!< Compensated pressure [Pa] */
+    float temperature;  /*!< Compensated temperature [deg C] */
+    float altitude;  /*!< Altitude [meters] calculated against reference pressure */
+} pressure_sensor_data;
+
+/* Operations each pressure sensor driver provides
+   Measurement is started with 'start', advanced without blocking with 'poll'
+   and its result (pressure and temperature) is returned by 'read_sample',
+   that blocks until measurement is complete.
+ */
+typedef struct {
+    const char* name;
+    esp_err_t (*init)(int pin_sda, int pin_scl);
+    esp_err_t (*set_resolution)(uint8_t level);
+    esp_err_t (*start)(void);
+    bool (*poll)(void);
+    esp_err_t (*read_sample)(pressure_sensor_data* sample);
+    void (*power_down)(void);
+} pressure_sensor_driver;
+
+extern const pressure_sensor_driver bmp180_pressure_sensor;
+extern const pressure_sensor_driver bmp280_pressure_sensor;
+
+/**
+@brief Initialize pressure sensor selected in menuconfig
+
+@param pin_sda I2C data pin
+@param pin_scl I2C clock pin
+
+@return
+    - ESP_OK - sensor initialized
+    - error code reported by the sensor driver
+*/
+esp_err_t pressure_sensor_init(int pin_sda, int pin_scl);
+esp_err_t pressure_sensor_set_resolution(uint8_t level);
+esp_err_t pressure_sensor_start(void);
+bool pressure_sensor_poll(void);
+
+/**
+@brief Get result of measurement started with pressure_sensor_start()
+
+@param reference_pressure pressure [Pa] to calculate altitude against
+@param sample pointer to structure to save the results
+*/
+esp_err_t pressure_sensor_read_sample(unsigned long reference_pressure, pressure_sensor_data* sample);
+void pressure_sensor_power_down(void);
+const char* pressure_sensor_name(void);
+
+/**
+@brief Convert pressure into altitude using barometric formula
+
+Table driven implementation, about three times faster than powf().
+Error against pressure_sensor_altitude_exact() is below 0.06 m
+for pressure 30 - 110 kPa and reference pressure 90 - 106 kPa.
+
+@param pressure absolute pressure [Pa]
+@param reference_pressure pressure [Pa] at the reference (sea) level
+
+@return altitude [meters] above the reference level
+*/
+float pressure_sensor_altitude(uint32_t pressure, unsigned long reference_pressure);
+
+/**
+@brief Convert pressure into altitude using barometric formula with powf()
+*/
+float pressure_sensor_altitude_exact(uint32_t pressure, unsigned long reference_pressure);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PRESSURE_SENSOR_H
@@ -13,8 +13,10 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "driver/gpio.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "thingspeak.h"
@@ -27,8 +29,12 @@ static const char* TAG = "ThingSpeak";
  */
 #define WEB_SERVER "api.thingspeak.com"
 
-// The API key below is configurable in menuconfig
+// The API key and channel ID below are configurable in menuconfig
 #define THINGSPEAK_WRITE_API_KEY CONFIG_THINGSPEAK_WRITE_API_KEY
+#define THINGSPEAK_CHANNEL_ID CONFIG_THINGSPEAK_CHANNEL_ID
+
+// Timestamps before 2017-01-01 mean that calendar time has not been set
+#define TIMESTAMP_VALID_SINCE 1483228800l
 
 static const char* get_request_start =
     "GET /update?key="
@@ -41,7 +47,15 @@ static const char* get_request_end =
     "User-Agent: esp32 / esp-idf\n"
     "\n";
 
+static const char* bulk_request_start =
+    "POST /channels/"THINGSPEAK_CHANNEL_ID"/bulk_update.json HTTP/1.1\n"
+    "Host: "WEB_SERVER"\n"
+    "Content-Type: application/json\n"
+    "User-Agent: esp32 / esp-idf\n"
+    "Connection: close\n";
+
 static http_client_data http_client = {0};
+static int response_status = 0;
 
 /* Collect chunks of data received from server
    into complete message and save it in proc_buf
@@ -78,11 +92,15 @@ static void disconnected(uint32_t *args)
     //
     // printf("%s\n", client->proc_buf);
 
+    response_status = 0;
+    if (client->proc_buf != NULL) {
+        sscanf(client->proc_buf, "HTTP/1.%*d %d", &response_status);
+    }
     free(client->proc_buf);
     client->proc_buf = NULL;
     client->proc_buf_size = 0;
 
-    ESP_LOGD(TAG, "Free heap %u", xPortGetFreeHeapSize());
+    ESP_LOGD(TAG, "Free heap %u", (unsigned int) xPortGetFreeHeapSize());
 }
 
 void thinkgspeak_post_data(altitude_data *altitude_record)
@@ -164,6 +182,104 @@ void thinkgspeak_post_data(altitude_data *altitude_record)
     free(get_request);
 }
 
+/* Format one record of bulk update, followed by comma
+   Every record has relative timestamp 'delta_t' [s], the time before the newest record,
+   as calendar time is not set unless synchronized with NTP server.
+   Absolute 'created_at' is added only if calendar time is valid.
+   Return length of formatted string as snprintf() does
+ */
+static int format_bulk_record(char* buf, size_t size, const altitude_data* record, unsigned long delta_t)
+{
+    char created_at[48] = "";
+    if (record->timestamp >= TIMESTAMP_VALID_SINCE) {
+        struct tm timeinfo = { 0 };
+        char strftime_value[32];
+        localtime_r(&record->timestamp, &timeinfo);
+        strftime(strftime_value, sizeof(strftime_value), "%Y-%m-%d %H:%M:%S %z", &timeinfo);
+        sprintf(created_at, "\"created_at\":\"%s\",", strftime_value);
+    }
+    return snprintf(buf, size,
+            "{%s"
+            "\"delta_t\":%lu,"
+            "\"field1\":%lu,"
+            "\"field2\":%lu,"
+            "\"field3\":%.1f,"
+            "\"field4\":%.1f,"
+            "\"field5\":%.1f,"
+            "\"field8\":%lu},",
+            created_at,
+            delta_t,
+            record->pressure,
+            record->reference_pressure,
+            record->altitude,
+            record->altitude_climbed,
+            record->temperature,
+            record->up_time);
+}
+
+/* Age [s] of record 'i' relative to the newest record in the batch,
+   both timed with the same clock, since up_time is counted whether or not
+   calendar time is set. The newest record is taken just before posting.
+ */
+static unsigned long bulk_record_delta_t(const altitude_data* records, size_t count, size_t i)
+{
+    unsigned long newest = records[count - 1].up_time;
+    if (records[i].up_time > newest) {
+        return 0;
+    }
+    return newest - records[i].up_time;
+}
+
+esp_err_t thinkgspeak_post_batch(altitude_data *altitude_records, size_t record_count)
+{
+    const char* json_start = "{\"write_api_key\":\""THINGSPEAK_WRITE_API_KEY"\",\"updates\":[";
+    const char* json_end = "]}";
+
+    if (record_count == 0) {
+        return ESP_OK;
+    }
+
+    // total size of JSON, the last comma is removed
+    int json_length = strlen(json_start) + strlen(json_end) - 1;
+    for (size_t i = 0; i < record_count; i++) {
+        json_length += format_bulk_record(NULL, 0, &altitude_records[i], bulk_record_delta_t(altitude_records, record_count, i));
+    }
+
+    int n = snprintf(NULL, 0, "Content-Length: %d\n\n", json_length);
+    int string_size = strlen(bulk_request_start) + n + json_length;
+    string_size += 1;  // '\0' - space for string termination character
+
+    // request string assembly
+    char * get_request = malloc(string_size);
+    if (get_request == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory");
+        return ESP_ERR_NO_MEM;
+    }
+    int pos = sprintf(get_request, "%sContent-Length: %d\n\n%s", bulk_request_start, json_length, json_start);
+    for (size_t i = 0; i < record_count; i++) {
+        pos += format_bulk_record(get_request + pos, string_size - pos, &altitude_records[i], bulk_record_delta_t(altitude_records, record_count, i));
+    }
+    // overwrite the last comma
+    strcpy(get_request + pos - 1, json_end);
+
+    gpio_set_level(BLUE_BLINK_GPIO, 1);
+    response_status = 0;
+    esp_err_t err = http_client_request(&http_client, WEB_SERVER, get_request);
+    gpio_set_level(BLUE_BLINK_GPIO, 0);
+
+    free(get_request);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (response_status < 200 || response_status > 299) {
+        ESP_LOGW(TAG, "Bulk update of %u records rejected, status %d", (unsigned int) record_count, response_status);
+        return ESP_ERR_THINGSPEAK_POST_FAILED;
+    }
+    ESP_LOGI(TAG, "Bulk update of %u records accepted", (unsigned int) record_count);
+    return ESP_OK;
+}
+
 void thinkgspeak_initialise()
 {
     http_client_on_process_chunk(&http_client, process_chunk);
@@ -22,6 +22,20 @@ extern "C" {
 #define ESP_ERR_THINGSPEAK_POST_FAILED          (ESP_ERR_THINGSPEAK_BASE + 1)
 
 void thinkgspeak_post_data(altitude_data *altitude_record);
+
+/**
+@brief Post several records in one request using bulk update
+
+Each record is timed with 'delta_t', its age in seconds relative to the newest record
+taken from 'up_time', so server places records correctly even if calendar time has not been set.
+Timestamp is posted as well, unless it is before 2017.
+
+@return
+    - ESP_OK - records accepted by server
+    - ESP_ERR_THINGSPEAK_POST_FAILED - server did not accept records
+    - ESP_ERR_HTTP_* - request failed
+*/
+esp_err_t thinkgspeak_post_batch(altitude_data *altitude_records, size_t record_count);
 void thinkgspeak_initialise();
 
 #ifdef __cplusplus
@@ -27,13 +27,52 @@
 extern "C" {
 #endif
 
+/* Transaction latency histogram
+   First bucket counts transactions shorter than TWI_LATENCY_BUCKET_US,
+   each next one twice as long, the last one all the longer transactions
+ */
+#define TWI_LATENCY_BUCKETS    8
+#define TWI_LATENCY_BUCKET_US  64
+
+/* Return codes of transfers
+   0 - success
+   2 - address not acknowledged
+   3 - data not acknowledged
+   4 - line busy, start condition could not be issued
+   5 - transaction timed out (I2C controller driver only)
+   6 - driver error, e.g. driver not installed (I2C controller driver only)
+ */
+
+typedef struct {
+    unsigned long transactions;  /*!< Transactions started, including failed ones */
+    unsigned long bytes;  /*!< Bytes transferred by successful transactions, including address bytes */
+    unsigned long nacks;  /*!< Transactions not acknowledged by slave (return code 2 or 3) */
+    unsigned long line_busy;  /*!< Transactions not started because bus was busy (return code 4) */
+    unsigned long timeouts;  /*!< Transactions that did not complete in time (return code 5) */
+    unsigned long driver_errors;  /*!< Transactions refused by the driver (return code 6) */
+    unsigned long stretch_timeouts;  /*!< Clock stretching exceeded TWI_CLOCK_STRETCH_US (bit-bang driver only) */
+    unsigned long time_us;  /*!< Total time [us] spent in transactions */
+    unsigned long latency[TWI_LATENCY_BUCKETS];  /*!< Histogram of transaction time */
+} twi_stats;
+
 void twi_init(unsigned char sda, unsigned char scl);
 void twi_stop(void);
 void twi_setClock(unsigned int freq);
 uint8_t twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop);
 uint8_t twi_readFrom(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop);
+// Write 'wlen' bytes then read 'rlen' bytes after a repeated start, with single stop at the end
+// 'rlen' of 0 is plain write, as twi_writeTo() with stop
+uint8_t twi_write_read(unsigned char address, unsigned char * wbuf, unsigned int wlen, unsigned char * rbuf, unsigned int rlen);
+// Not serialized with twi_bus transactions, use twi_bus_scan() on shared bus
 uint8_t twi_scan();
 
+/* Bus statistics are counted since power on / wake up or twi_reset_stats()
+   Both drivers serve a single bus, so these are statistics of that bus
+ */
+void twi_get_stats(twi_stats* stats);
+void twi_reset_stats(void);
+void twi_log_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
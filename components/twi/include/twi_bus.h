@@ -0,0 +1,76 @@
+/*
+ twi_bus.h - Shared I2C bus with per device handles
+
+ Serializes transactions of several devices on the same bus,
+ so each device may be served by its own task.
+ The bus is locked for a single transaction at a time,
+ so a task waits at most for one transaction of another device.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#ifndef TWI_BUS_H
+#define TWI_BUS_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TWI_BUS_MAX_DEVICES 4  // Number of devices that may be added to the bus
+
+typedef struct twi_device twi_device;
+
+/**
+@brief Add device to the bus, initializing the bus when adding the first device
+
+Tasks waiting for the bus are served in order of their priority.
+To get the bus ahead of other devices, transactions of time critical device
+are done at 'priority', if the calling task runs at lower priority.
+
+Add devices before starting tasks that use them.
+
+@param pin_sda GPIO of SDA line, the same for all devices
+@param pin_scl GPIO of SCL line, the same for all devices
+@param address 7-bit address of device
+@param priority minimum task priority for transactions of this device, 0 for no change
+
+@return
+    - handle of device
+    - NULL - bus is already initialized on other pins or there are too many devices
+*/
+twi_device* twi_bus_add_device(int pin_sda, int pin_scl, unsigned char address, UBaseType_t priority);
+
+/**
+@brief Remove device from the bus, releasing bus pins once the last device is removed
+*/
+void twi_bus_remove_device(twi_device* device);
+
+/* Transactions with return codes of twi_writeTo() / twi_readFrom()
+   Stop condition is always sent at the end
+ */
+uint8_t twi_device_write(twi_device* device, unsigned char* buf, unsigned int len);
+uint8_t twi_device_read(twi_device* device, unsigned char* buf, unsigned int len);
+uint8_t twi_device_write_read(twi_device* device, unsigned char* wbuf, unsigned int wlen, unsigned char* rbuf, unsigned int rlen);
+
+/**
+@brief Count devices that acknowledge their address, without disturbing transactions of added devices
+
+Use it instead of twi_scan() once devices are on the bus.
+
+@return number of devices found, 0 if no device has been added, so the bus is not initialized
+*/
+uint8_t twi_bus_scan(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TWI_BUS_H
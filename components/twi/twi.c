@@ -19,22 +19,46 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "sdkconfig.h"
+
+// Bit-bang driver, unless I2C controller is selected in menuconfig
+#if !CONFIG_TWI_BACKEND_HW
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "soc/gpio_reg.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "rom/ets_sys.h"
 
 #include "include/twi.h"
+#include "twi_stats.h"
 #include "wiring.h"
 
 static const char* TAG = "I2C";
 
-unsigned char twi_dcount = 18;
 static unsigned char twi_sda, twi_scl;
 
-
-static inline void SDA_LOW() {
+/* Bus timing is paced with CPU cycle counter
+   and calibrated against current CPU frequency,
+   so bus clock stays the same when CPU frequency changes.
+   Bit and byte routines are in IRAM, so flash cache misses
+   do not stretch SCL periods, and they call nothing outside IRAM,
+   statistics and calibration are done around them.
+ */
+#define TWI_CLOCK_STRETCH_US 100  // Maximum clock stretching time
+#define TWI_OVERHEAD_BITS 16  // Bits timed to measure the overhead
+
+static unsigned int twi_clock = 100000;
+static uint32_t twi_cpu_mhz = 0;
+static uint32_t twi_dcycles;  // Cycles to wait each half period of SCL
+static uint32_t twi_overhead_cycles;  // Cycles spent in GPIO register access and calls each half period
+static uint32_t twi_stretch_cycles;  // Cycles to wait for slave releasing SCL
+static unsigned int twi_stretch_timeouts;  // Counted in current transaction
+
+
+static inline void IRAM_ATTR SDA_LOW() {
   // Enable SDA (becomes output and since GPO is 0 for the pin,
   // it will pull the line low)
   if (twi_sda < 32) {
@@ -45,7 +69,7 @@ static inline void SDA_LOW() {
   }
 }
 
-static inline void SDA_HIGH() {
+static inline void IRAM_ATTR SDA_HIGH() {
   //Disable SDA (becomes input and since it has pullup it will go high)
   if (twi_sda < 32) {
     REG_WRITE(GPIO_ENABLE_W1TC_REG, BIT(twi_sda));
@@ -55,7 +79,7 @@ static inline void SDA_HIGH() {
   }
 }
 
-static inline uint32_t SDA_READ() { 
+static inline uint32_t IRAM_ATTR SDA_READ() {
   if (twi_sda < 32) {
     return (REG_READ(GPIO_IN_REG) & BIT(twi_sda)) != 0;
   }
@@ -64,7 +88,7 @@ static inline uint32_t SDA_READ() {
   }
 }
 
-static void SCL_LOW() {
+static void IRAM_ATTR SCL_LOW() {
   if (twi_scl < 32) {
     REG_WRITE(GPIO_ENABLE_W1TS_REG, BIT(twi_scl));
   }
@@ -73,7 +97,7 @@ static void SCL_LOW() {
   }
 }
 
-static void SCL_HIGH() {
+static void IRAM_ATTR SCL_HIGH() {
   if (twi_scl < 32) {
     REG_WRITE(GPIO_ENABLE_W1TC_REG, BIT(twi_scl));
   }
@@ -82,7 +106,7 @@ static void SCL_HIGH() {
   }
 }
 
-static uint32_t SCL_READ() {
+static uint32_t IRAM_ATTR SCL_READ() {
   if (twi_scl < 32) {
     return (REG_READ(GPIO_IN_REG) & BIT(twi_scl)) != 0;
   }
@@ -92,32 +116,50 @@ static uint32_t SCL_READ() {
 }
 
 
-#ifndef FCPU80
-#define FCPU80 80000000L
-#endif
+static void IRAM_ATTR twi_delay(uint32_t cycles);
+static void IRAM_ATTR twi_wait_scl_high(void);
+
+/* Time the register accesses and calls of a bit, with zero delay,
+   on idle bus where releasing the lines does not change them
+   APB access time does not scale with CPU clock, so it is measured
+   again on each recalibration rather than taken as a constant
+ */
+static uint32_t IRAM_ATTR twi_measure_overhead(void){
+  uint32_t start = twi_ccount();
+  for (int i = 0; i < TWI_OVERHEAD_BITS; i++) {
+    SCL_HIGH();
+    SDA_HIGH();
+    twi_delay(0);
+    SCL_HIGH();
+    twi_wait_scl_high();
+    SDA_READ();
+    twi_delay(0);
+  }
+  return (twi_ccount() - start) / (2 * TWI_OVERHEAD_BITS);
+}
+
+static void twi_calibrate(void){
+  twi_cpu_mhz = ets_get_cpu_frequency();
+  twi_stretch_cycles = TWI_CLOCK_STRETCH_US * twi_cpu_mhz;
+  twi_overhead_cycles = twi_measure_overhead();
+  uint32_t half_period = twi_cpu_mhz * 1000000 / (2 * twi_clock);
+  twi_dcycles = (half_period > twi_overhead_cycles) ? half_period - twi_overhead_cycles : 0;
+  unsigned int scl = twi_cpu_mhz * 1000000 / (2 * (twi_dcycles + twi_overhead_cycles));
+  if (twi_dcycles == 0) {
+    ESP_LOGW(TAG, "Clock %u Hz not reached at CPU %u MHz, SCL is %u Hz", twi_clock, twi_cpu_mhz, scl);
+  }
+  ESP_LOGD(TAG, "Clock %u Hz at CPU %u MHz, overhead %u, delay %u cycles, SCL %u Hz",
+      twi_clock, twi_cpu_mhz, twi_overhead_cycles, twi_dcycles, scl);
+}
 
-#if F_CPU == FCPU80
-#define TWI_CLOCK_STRETCH 800
-#else
-#define TWI_CLOCK_STRETCH 1600
-#endif
+// Recalibrate if CPU frequency has changed since last transaction
+static inline void twi_check_calibration(void){
+  if (ets_get_cpu_frequency() != twi_cpu_mhz) twi_calibrate();
+}
 
 void twi_setClock(unsigned int freq){
-#if F_CPU == FCPU80
-  if(freq <= 100000) twi_dcount = 19;//about 100KHz
-  else if(freq <= 200000) twi_dcount = 8;//about 200KHz
-  else if(freq <= 300000) twi_dcount = 3;//about 300KHz
-  else if(freq <= 400000) twi_dcount = 1;//about 400KHz
-  else twi_dcount = 1;//about 400KHz
-#else
-  if(freq <= 100000) twi_dcount = 32;//about 100KHz
-  else if(freq <= 200000) twi_dcount = 14;//about 200KHz
-  else if(freq <= 300000) twi_dcount = 8;//about 300KHz
-  else if(freq <= 400000) twi_dcount = 5;//about 400KHz
-  else if(freq <= 500000) twi_dcount = 3;//about 500KHz
-  else if(freq <= 600000) twi_dcount = 2;//about 600KHz
-  else twi_dcount = 1;//about 700KHz
-#endif
+  twi_clock = freq;
+  twi_calibrate();
 }
 
 void twi_init(unsigned char sda, unsigned char scl){
@@ -139,79 +181,92 @@ void twi_stop(void){
   pinMode(twi_scl, INPUT);
 }
 
-static void twi_delay(unsigned char v){
-  unsigned int i;
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
-  unsigned int reg;
-  for(i=0;i<v;i++) reg = REG_READ(GPIO_IN_REG);
-#pragma GCC diagnostic pop
+static void IRAM_ATTR twi_delay(uint32_t cycles){
+  uint32_t start = twi_ccount();
+  while (twi_ccount() - start < cycles);
 }
 
-static bool twi_write_start(void) {
+// Clock stretching (up to TWI_CLOCK_STRETCH_US)
+static void IRAM_ATTR twi_wait_scl_high(void){
+  uint32_t start = twi_ccount();
+  while (SCL_READ() == 0) {
+    if (twi_ccount() - start >= twi_stretch_cycles) {
+      twi_stretch_timeouts++;
+      return;
+    }
+  }
+}
+
+static bool IRAM_ATTR twi_write_start(void) {
   SCL_HIGH();
   SDA_HIGH();
   if (SDA_READ() == 0) return false;
-  twi_delay(twi_dcount);
+  twi_delay(twi_dcycles);
   SDA_LOW();
-  twi_delay(twi_dcount);
+  twi_delay(twi_dcycles);
   return true;
 }
 
-static bool twi_write_stop(void){
-  unsigned int i = 0;
+// Start condition issued without releasing the bus after previous byte
+static bool IRAM_ATTR twi_write_repeated_start(void) {
   SCL_LOW();
+  SDA_HIGH();
+  twi_delay(twi_dcycles);
+  SCL_HIGH();
+  twi_wait_scl_high();
+  if (SDA_READ() == 0) return false;
+  twi_delay(twi_dcycles);
   SDA_LOW();
-  twi_delay(twi_dcount);
+  twi_delay(twi_dcycles);
+  return true;
+}
+
+static bool IRAM_ATTR twi_write_stop(void){
+  SCL_LOW();
+  SDA_LOW();
+  twi_delay(twi_dcycles);
   SCL_HIGH();
-  while (SCL_READ() == 0 && (i++) < TWI_CLOCK_STRETCH);// Clock stretching (up to 100us)
-  twi_delay(twi_dcount);
+  twi_wait_scl_high();
+  twi_delay(twi_dcycles);
   SDA_HIGH();
-  twi_delay(twi_dcount);
+  twi_delay(twi_dcycles);
 
   return true;
 }
 
-bool do_log = false;
-static bool twi_write_bit(bool bit) {
-  unsigned int i = 0;
+static bool IRAM_ATTR twi_write_bit(bool bit) {
   SCL_LOW();
-  if (bit) {SDA_HIGH(); if (do_log) {twi_delay(twi_dcount+1);}}
-  else {SDA_LOW(); if (do_log) {} }
-  twi_delay(twi_dcount+1);
+  if (bit) SDA_HIGH();
+  else SDA_LOW();
+  twi_delay(twi_dcycles);
   SCL_HIGH();
-  while (SCL_READ() == 0 && (i++) < TWI_CLOCK_STRETCH);// Clock stretching (up to 100us)
-  twi_delay(twi_dcount);
+  twi_wait_scl_high();
+  twi_delay(twi_dcycles);
   return true;
 }
 
-static bool twi_read_bit(void) {
-  unsigned int i = 0;
+static bool IRAM_ATTR twi_read_bit(void) {
   SCL_LOW();
   SDA_HIGH();
-  twi_delay(twi_dcount+2);
+  twi_delay(twi_dcycles);
   SCL_HIGH();
-  while (SCL_READ() == 0 && (i++) < TWI_CLOCK_STRETCH);// Clock stretching (up to 100us)
+  twi_wait_scl_high();
   bool bit = SDA_READ();
-  twi_delay(twi_dcount);
+  twi_delay(twi_dcycles);
   return bit;
 }
 
-static bool twi_write_byte(unsigned char byte) {
+static bool IRAM_ATTR twi_write_byte(unsigned char byte) {
   
   unsigned char bit;
   for (bit = 0; bit < 8; bit++) {
     twi_write_bit((byte & 0x80) != 0);
     byte <<= 1;
   }
-  if (do_log) {
-    printf("\n");
-    do_log = false;
-  }
   return !twi_read_bit(); //NACK/ACK
 }
 
-static unsigned char twi_read_byte(bool nack) {
+static unsigned char IRAM_ATTR twi_read_byte(bool nack) {
   unsigned char byte = 0;
   unsigned char bit;
   for (bit = 0; bit < 8; bit++) byte = (byte << 1) | twi_read_bit();
@@ -219,7 +274,7 @@ static unsigned char twi_read_byte(bool nack) {
   return byte;
 }
 
-unsigned char twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop){
+static unsigned char IRAM_ATTR twi_write_to(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop){
   unsigned int i;
   if(!twi_write_start()) return 4;//line busy
   if(!twi_write_byte(((address << 1) | 0) & 0xFF)) {
@@ -236,14 +291,14 @@ unsigned char twi_writeTo(unsigned char address, unsigned char * buf, unsigned i
   i = 0;
   while(SDA_READ() == 0 && (i++) < 10){
     SCL_LOW();
-    twi_delay(twi_dcount);
+    twi_delay(twi_dcycles);
     SCL_HIGH();
-    twi_delay(twi_dcount);
+    twi_delay(twi_dcycles);
   }
   return 0;
 }
 
-unsigned char twi_readFrom(unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop){
+static unsigned char IRAM_ATTR twi_read_from(unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop){
   unsigned int i;
   if(!twi_write_start()) return 4;//line busy
   if(!twi_write_byte(((address << 1) | 1) & 0xFF)) {
@@ -256,13 +311,76 @@ unsigned char twi_readFrom(unsigned char address, unsigned char* buf, unsigned i
   i = 0;
   while(SDA_READ() == 0 && (i++) < 10){
     SCL_LOW();
-    twi_delay(twi_dcount);
+    twi_delay(twi_dcycles);
     SCL_HIGH();
-    twi_delay(twi_dcount);
+    twi_delay(twi_dcycles);
   }
   return 0;
 }
 
+static unsigned char IRAM_ATTR twi_write_then_read(unsigned char address, unsigned char* wbuf, unsigned int wlen, unsigned char* rbuf, unsigned int rlen){
+  unsigned int i;
+  if(!twi_write_start()) return 4;//line busy
+  if(!twi_write_byte(((address << 1) | 0) & 0xFF)) {
+    twi_write_stop();
+    return 2; //received NACK on transmit of address
+  }
+  for(i=0; i<wlen; i++) {
+    if(!twi_write_byte(wbuf[i])) {
+      twi_write_stop();
+      return 3;//received NACK on transmit of data
+    }
+  }
+  if(!twi_write_repeated_start()) {
+    twi_write_stop();
+    return 4;//line busy
+  }
+  if(!twi_write_byte(((address << 1) | 1) & 0xFF)) {
+    twi_write_stop();
+    return 2;//received NACK on transmit of address
+  }
+  for(i=0; i<(rlen-1); i++) rbuf[i] = twi_read_byte(false);
+  rbuf[rlen-1] = twi_read_byte(true);
+  twi_write_stop();
+  i = 0;
+  while(SDA_READ() == 0 && (i++) < 10){
+    SCL_LOW();
+    twi_delay(twi_dcycles);
+    SCL_HIGH();
+    twi_delay(twi_dcycles);
+  }
+  return 0;
+}
+
+// Prepare timing before transaction, returning its start time for statistics
+static int64_t twi_begin(void){
+  twi_check_calibration();
+  twi_stretch_timeouts = 0;
+  return esp_timer_get_time();
+}
+
+static uint8_t twi_end(int64_t start, uint8_t rc, unsigned int bytes){
+  rc = twi_stats_end(start, rc, bytes);
+  if (twi_stretch_timeouts > 0) twi_stats_stretch_timeouts(twi_stretch_timeouts);
+  return rc;
+}
+
+unsigned char twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop){
+  int64_t start = twi_begin();
+  return twi_end(start, twi_write_to(address, buf, len, sendStop), len + 1);
+}
+
+unsigned char twi_readFrom(unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop){
+  int64_t start = twi_begin();
+  return twi_end(start, twi_read_from(address, buf, len, sendStop), len + 1);
+}
+
+unsigned char twi_write_read(unsigned char address, unsigned char* wbuf, unsigned int wlen, unsigned char* rbuf, unsigned int rlen){
+  if(rlen == 0) return twi_writeTo(address, wbuf, wlen, true);//nothing to read, skip repeated start
+  int64_t start = twi_begin();
+  return twi_end(start, twi_write_then_read(address, wbuf, wlen, rbuf, rlen), wlen + rlen + 2);
+}
+
 unsigned char twi_scan()
 {
     uint8_t reg = 0x00;
@@ -276,3 +394,5 @@ unsigned char twi_scan()
     }
     return device_count;
 }
+
+#endif  // !CONFIG_TWI_BACKEND_HW
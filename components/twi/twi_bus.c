@@ -0,0 +1,179 @@
+/*
+ twi_bus.c - Shared I2C bus with per device handles
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "include/twi.h"
+#include "include/twi_bus.h"
+
+static const char* TAG = "I2C bus";
+
+struct twi_device {
+    bool used;
+    unsigned char address;
+    UBaseType_t priority;
+};
+
+static twi_device devices[TWI_BUS_MAX_DEVICES];
+static unsigned int device_count = 0;
+static int bus_sda, bus_scl;
+
+/* Mutex rather than binary semaphore, so the task holding the bus
+   inherits priority of a higher priority task waiting for it
+ */
+static SemaphoreHandle_t bus_lock = NULL;
+static portMUX_TYPE bus_lock_init = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* Create the bus lock on first use
+   Mutex can not be created inside critical section,
+   so each racing task creates one and only the first one is kept
+ */
+static bool twi_bus_create_lock(void)
+{
+    if (bus_lock != NULL) {
+        return true;
+    }
+    SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        ESP_LOGE(TAG, "Lock create failed");
+        return false;
+    }
+    portENTER_CRITICAL(&bus_lock_init);
+    if (bus_lock == NULL) {
+        bus_lock = lock;
+        lock = NULL;
+    }
+    portEXIT_CRITICAL(&bus_lock_init);
+    if (lock != NULL) {
+        vSemaphoreDelete(lock);
+    }
+    return true;
+}
+
+twi_device* twi_bus_add_device(int pin_sda, int pin_scl, unsigned char address, UBaseType_t priority)
+{
+    if (twi_bus_create_lock() == false) {
+        return NULL;
+    }
+    xSemaphoreTake(bus_lock, portMAX_DELAY);
+    if (device_count > 0 && (pin_sda != bus_sda || pin_scl != bus_scl)) {
+        xSemaphoreGive(bus_lock);
+        ESP_LOGE(TAG, "Bus is already on SDA %d, SCL %d", bus_sda, bus_scl);
+        return NULL;
+    }
+    twi_device* device = NULL;
+    for (int i = 0; i < TWI_BUS_MAX_DEVICES; i++) {
+        if (devices[i].used == false) {
+            device = &devices[i];
+            break;
+        }
+    }
+    if (device == NULL) {
+        xSemaphoreGive(bus_lock);
+        ESP_LOGE(TAG, "No room for device 0x%02x", address);
+        return NULL;
+    }
+    device->used = true;
+    device->address = address;
+    device->priority = priority;
+    if (device_count++ == 0) {
+        bus_sda = pin_sda;
+        bus_scl = pin_scl;
+        twi_init(pin_sda, pin_scl);
+    }
+    xSemaphoreGive(bus_lock);
+
+    ESP_LOGD(TAG, "Device 0x%02x added, %u on the bus", address, device_count);
+    return device;
+}
+
+void twi_bus_remove_device(twi_device* device)
+{
+    if (device == NULL || device->used == false) {
+        return;
+    }
+    xSemaphoreTake(bus_lock, portMAX_DELAY);
+    device->used = false;
+    if (--device_count == 0) {
+        twi_stop();
+    }
+    xSemaphoreGive(bus_lock);
+}
+
+// Lock the bus, returning priority of calling task to restore with twi_bus_unlock()
+static UBaseType_t twi_bus_lock(twi_device* device)
+{
+    UBaseType_t task_priority = uxTaskPriorityGet(NULL);
+    if (device->priority > task_priority) {
+        // raise before waiting, so this task is queued for the bus at new priority
+        vTaskPrioritySet(NULL, device->priority);
+    }
+    xSemaphoreTake(bus_lock, portMAX_DELAY);
+    return task_priority;
+}
+
+static void twi_bus_unlock(twi_device* device, UBaseType_t task_priority)
+{
+    xSemaphoreGive(bus_lock);
+    if (device->priority > task_priority) {
+        vTaskPrioritySet(NULL, task_priority);
+    }
+}
+
+uint8_t twi_device_write(twi_device* device, unsigned char* buf, unsigned int len)
+{
+    UBaseType_t task_priority = twi_bus_lock(device);
+    uint8_t rc = twi_writeTo(device->address, buf, len, true);
+    twi_bus_unlock(device, task_priority);
+    return rc;
+}
+
+uint8_t twi_device_read(twi_device* device, unsigned char* buf, unsigned int len)
+{
+    UBaseType_t task_priority = twi_bus_lock(device);
+    uint8_t rc = twi_readFrom(device->address, buf, len, true);
+    twi_bus_unlock(device, task_priority);
+    return rc;
+}
+
+uint8_t twi_device_write_read(twi_device* device, unsigned char* wbuf, unsigned int wlen, unsigned char* rbuf, unsigned int rlen)
+{
+    UBaseType_t task_priority = twi_bus_lock(device);
+    uint8_t rc = twi_write_read(device->address, wbuf, wlen, rbuf, rlen);
+    twi_bus_unlock(device, task_priority);
+    return rc;
+}
+
+uint8_t twi_bus_scan(void)
+{
+    uint8_t reg = 0x00;
+    uint8_t found = 0;
+
+    if (bus_lock == NULL) {
+        return 0;
+    }
+    // bus is locked for each address separately, so devices are not held up for the whole scan
+    for (uint8_t address = 0; address < 127; address++) {
+        xSemaphoreTake(bus_lock, portMAX_DELAY);
+        uint8_t rc = (device_count > 0) ? twi_writeTo(address, &reg, 1, true) : 4;
+        xSemaphoreGive(bus_lock);
+        if (rc == 0) {
+            ESP_LOGD(TAG, "Device found at 0x%02x", address);
+            found++;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,176 @@
+/*
+  twi_hw.c - I2C library for ESP32 using I2C controller
+
+  Implements the same API as twi.c on top of esp-idf I2C driver.
+  Transfers are queued as command links and run by the I2C controller
+  under interrupt control, so the calling task is blocked
+  and the CPU is free while the bus is busy.
+  Select it with 'make menuconfig' under I2C bus > I2C bus driver.
+
+  This file is part of the ESP32 Everest Run project
+  https://github.com/krzychb/esp32-everest-run
+
+  Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+  This work is licensed under the Apache License, Version 2.0, January 2004
+  See the file LICENSE for details.
+*/
+
+#include "sdkconfig.h"
+
+#if CONFIG_TWI_BACKEND_HW
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/i2c.h"
+#include "esp_log.h"
+
+#include "include/twi.h"
+#include "twi_stats.h"
+
+static const char* TAG = "I2C";
+
+#define TWI_PORT CONFIG_TWI_HW_PORT
+#define TWI_TIMEOUT_MS 100  // Maximum time for single transaction
+
+#define ACK_CHECK_EN  true
+#define ACK_VAL       0x0  // I2C ack value
+#define NACK_VAL      0x1  // I2C nack value
+
+static i2c_config_t twi_config = {0};
+static bool twi_installed = false;
+
+
+/* Map result of command link execution
+   to return codes in twi.h, the same as bit-bang driver for NACK
+ */
+static uint8_t twi_result(esp_err_t err)
+{
+    switch (err) {
+    case ESP_OK:
+        return 0;
+    case ESP_FAIL:
+        return 2;  // received NACK
+    case ESP_ERR_TIMEOUT:
+        return 5;  // bus held or slave stretching clock for too long
+    default:
+        // ESP_ERR_INVALID_STATE if driver is not installed, ESP_ERR_INVALID_ARG
+        ESP_LOGD(TAG, "Transaction failed err=%d", err);
+        return 6;
+    }
+}
+
+void twi_setClock(unsigned int freq)
+{
+    twi_config.master.clk_speed = freq;
+    if (twi_installed) {
+        i2c_param_config(TWI_PORT, &twi_config);
+    }
+}
+
+void twi_init(unsigned char sda, unsigned char scl)
+{
+    twi_config.mode = I2C_MODE_MASTER;
+    twi_config.sda_io_num = sda;
+    twi_config.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    twi_config.scl_io_num = scl;
+    twi_config.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    twi_config.master.clk_speed = 100000;
+    i2c_param_config(TWI_PORT, &twi_config);
+
+    if (twi_installed == false) {
+        esp_err_t err = i2c_driver_install(TWI_PORT, I2C_MODE_MASTER, 0, 0, 0);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Driver install failed err=%d", err);
+            return;
+        }
+        twi_installed = true;
+    }
+}
+
+void twi_stop(void)
+{
+    if (twi_installed) {
+        i2c_driver_delete(TWI_PORT);
+        twi_installed = false;
+    }
+}
+
+uint8_t twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    int64_t start = esp_timer_get_time();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+    if (len > 0) {
+        i2c_master_write(cmd, buf, len, ACK_CHECK_EN);
+    }
+    if (sendStop) {
+        i2c_master_stop(cmd);
+    }
+    esp_err_t err = i2c_master_cmd_begin(TWI_PORT, cmd, TWI_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    return twi_stats_end(start, twi_result(err), len + 1);
+}
+
+uint8_t twi_readFrom(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    if (len == 0) {
+        return 0;
+    }
+    int64_t start = esp_timer_get_time();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_READ, ACK_CHECK_EN);
+    if (len > 1) {
+        i2c_master_read(cmd, buf, len - 1, ACK_VAL);
+    }
+    i2c_master_read_byte(cmd, buf + len - 1, NACK_VAL);
+    if (sendStop) {
+        i2c_master_stop(cmd);
+    }
+    esp_err_t err = i2c_master_cmd_begin(TWI_PORT, cmd, TWI_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    return twi_stats_end(start, twi_result(err), len + 1);
+}
+
+uint8_t twi_write_read(unsigned char address, unsigned char * wbuf, unsigned int wlen, unsigned char * rbuf, unsigned int rlen)
+{
+    if (rlen == 0) {
+        return twi_writeTo(address, wbuf, wlen, true);
+    }
+    int64_t start = esp_timer_get_time();
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+    if (wlen > 0) {
+        i2c_master_write(cmd, wbuf, wlen, ACK_CHECK_EN);
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_READ, ACK_CHECK_EN);
+    if (rlen > 1) {
+        i2c_master_read(cmd, rbuf, rlen - 1, ACK_VAL);
+    }
+    i2c_master_read_byte(cmd, rbuf + rlen - 1, NACK_VAL);
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(TWI_PORT, cmd, TWI_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    return twi_stats_end(start, twi_result(err), wlen + rlen + 2);
+}
+
+uint8_t twi_scan()
+{
+    uint8_t reg = 0x00;
+    uint8_t device_count = 0;
+
+    for (uint8_t i = 0; i < 127; i++) {
+        if (twi_writeTo(i, &reg, 1, true) == 0) {
+            ESP_LOGD(TAG, "Device found at 0x%02x", i);
+            device_count++;
+        }
+    }
+    return device_count;
+}
+
+#endif  // CONFIG_TWI_BACKEND_HW
@@ -0,0 +1,106 @@
+/*
+  twi_stats.c - I2C bus statistics shared by bit-bang and I2C controller drivers
+
+  This file is part of the ESP32 Everest Run project
+  https://github.com/krzychb/esp32-everest-run
+
+  Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+  This work is licensed under the Apache License, Version 2.0, January 2004
+  See the file LICENSE for details.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "include/twi.h"
+#include "twi_stats.h"
+
+static const char* TAG = "I2C";
+
+static twi_stats stats = {0};
+// Transactions of devices served by different tasks may end on both cores
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+uint8_t twi_stats_end(int64_t start_us, uint8_t rc, unsigned int bytes)
+{
+    uint32_t time_us = (uint32_t) (esp_timer_get_time() - start_us);
+
+    unsigned int bucket = 0;
+    uint32_t buckets = time_us / TWI_LATENCY_BUCKET_US;
+    while (buckets > 0 && bucket < TWI_LATENCY_BUCKETS - 1) {
+        buckets >>= 1;
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.transactions++;
+    stats.time_us += time_us;
+    switch (rc) {
+    case 0:
+        stats.bytes += bytes;
+        break;
+    case 2:
+    case 3:
+        stats.nacks++;
+        break;
+    case 4:
+        stats.line_busy++;
+        break;
+    case 5:
+        stats.timeouts++;
+        break;
+    default:
+        stats.driver_errors++;
+        break;
+    }
+    stats.latency[bucket]++;
+    portEXIT_CRITICAL(&stats_lock);
+    return rc;
+}
+
+void twi_stats_stretch_timeouts(unsigned int count)
+{
+    portENTER_CRITICAL(&stats_lock);
+    stats.stretch_timeouts += count;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void twi_get_stats(twi_stats* bus_stats)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *bus_stats = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void twi_reset_stats(void)
+{
+    portENTER_CRITICAL(&stats_lock);
+    memset(&stats, 0, sizeof(stats));
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void twi_log_stats(void)
+{
+    char histogram[TWI_LATENCY_BUCKETS * 11 + 1];
+    int pos = 0;
+    twi_stats snapshot;
+
+    twi_get_stats(&snapshot);
+
+    for (int i = 0; i < TWI_LATENCY_BUCKETS; i++) {
+        pos += snprintf(histogram + pos, sizeof(histogram) - pos, " %lu", snapshot.latency[i]);
+    }
+    // bytes over time spent in transactions, to compare drivers on the same sensor traffic
+    unsigned long throughput = 0;
+    if (snapshot.time_us > 0) {
+        throughput = (unsigned long) ((uint64_t) snapshot.bytes * 1000000 / snapshot.time_us);
+    }
+    ESP_LOGI(TAG, "Transactions %lu, bytes %lu, bus busy %lu us, throughput %lu B/s",
+        snapshot.transactions, snapshot.bytes, snapshot.time_us, throughput);
+    ESP_LOGI(TAG, "NACKs %lu, line busy %lu, timeouts %lu, driver errors %lu, clock stretch timeouts %lu",
+        snapshot.nacks, snapshot.line_busy, snapshot.timeouts, snapshot.driver_errors, snapshot.stretch_timeouts);
+    ESP_LOGI(TAG, "Latency histogram (%u us buckets, doubling):%s", TWI_LATENCY_BUCKET_US, histogram);
+}
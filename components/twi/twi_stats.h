@@ -0,0 +1,35 @@
+/*
+  twi_stats.h - I2C bus statistics shared by bit-bang and I2C controller drivers
+
+  This file is part of the ESP32 Everest Run project
+  https://github.com/krzychb/esp32-everest-run
+
+  Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+  This work is licensed under the Apache License, Version 2.0, January 2004
+  See the file LICENSE for details.
+*/
+#ifndef TWI_STATS_H
+#define TWI_STATS_H
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+static inline uint32_t IRAM_ATTR twi_ccount(void) {
+  uint32_t ccount;
+  __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+  return ccount;
+}
+
+/* Record transaction started at time 'start_us' of esp_timer_get_time()
+   that transferred 'bytes' including address bytes
+   and ended with return code 'rc', that is passed through
+   Timer rather than CCOUNT, so time is right if the task blocked
+   in I2C driver moves to the other core or CPU frequency changes.
+ */
+uint8_t twi_stats_end(int64_t start_us, uint8_t rc, unsigned int bytes);
+
+// Record 'count' times slave held SCL low longer than allowed
+void twi_stats_stretch_timeouts(unsigned int count);
+
+#endif  // TWI_STATS_H
@@ -178,3 +178,8 @@ void initialise_weather_data_retrieval(unsigned long retreival_period)
     xTaskCreate(&http_request_task, "http_request_task", 2 * 2048, NULL, 5, NULL);
     ESP_LOGI(TAG, "HTTP request task started");
 }
+
+void update_weather_data_retrieval(unsigned long retreival_period)
+{
+    weather.retreival_period = retreival_period;
+}
@@ -32,6 +32,7 @@ typedef struct {
 
 void on_weather_data_retrieval(weather_data_callback data_retreived_cb);
 void initialise_weather_data_retrieval(unsigned long retreival_period);
+void update_weather_data_retrieval(unsigned long retreival_period);
 
 #ifdef __cplusplus
 }
@@ -12,11 +12,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include <string.h>
+#include <time.h>
 #include "esp_system.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 
 #include "esp_event_loop.h"
 #include "esp_wifi.h"
+#include "tcpip_adapter.h"
+#include "lwip/ip4_addr.h"
 
 #include "wifi.h"
 
@@ -32,13 +37,122 @@ static const char* TAG = "Wi-Fi";
 #define EXAMPLE_WIFI_PASS CONFIG_WIFI_PASSWORD
 
 /* FreeRTOS event group to signal when we are connected & ready to make a request */
-EventGroupHandle_t wifi_event_group;
+EventGroupHandle_t wifi_event_group = NULL;
 
 /* The event group allows multiple bits for each event,
    but we only care about one event - are we connected
    to the AP with an IP? */
 const int CONNECTED_BIT = BIT0;
 
+#if CONFIG_WIFI_FAST_RECONNECT
+#define CACHED_IP_LIFETIME CONFIG_WIFI_CACHED_IP_LIFETIME
+#else
+#define CACHED_IP_LIFETIME 0
+#endif
+
+/* Association state retained in deep sleep for fast reconnect
+   Connecting to known BSSID on known channel skips the scan,
+   and reusing IP address skips DHCP
+ */
+typedef struct {
+    bool valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    tcpip_adapter_ip_info_t ip_info;
+    tcpip_adapter_dns_info_t dns_info;
+    time_t leased;  /*!< Time IP address has been obtained with DHCP */
+} wifi_cache;
+
+RTC_DATA_ATTR static wifi_cache cache = {0};
+RTC_DATA_ATTR static wifi_connect_stats stats = {0};
+
+static bool fast_connect = false;  // Connecting with cached state
+static bool dhcp_used = true;  // IP address is obtained with DHCP
+static bool radio_on = false;  // Wi-Fi is started and should reconnect if disconnected
+static bool connect_timed = false;  // Time to the first IP has been accounted
+static uint32_t connect_start;
+
+// Access point to connect to, with cached BSSID and channel if 'fast' is set
+static void wifi_set_station_config(bool fast)
+{
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = EXAMPLE_WIFI_SSID,
+            .password = EXAMPLE_WIFI_PASS,
+        },
+    };
+    if (fast) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = cache.channel;
+    }
+    ESP_LOGI(TAG, "Setting SSID %s...", wifi_config.sta.ssid);
+    ESP_ERROR_CHECK( esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) );
+}
+
+// Set IP address without DHCP, return false if there is no address to set
+static bool wifi_set_ip(bool fast)
+{
+    tcpip_adapter_ip_info_t ip_info;
+    tcpip_adapter_dns_info_t dns_info;
+
+#if CONFIG_WIFI_STATIC_IP
+    ip4addr_aton(CONFIG_WIFI_STATIC_IP_ADDRESS, &ip_info.ip);
+    ip4addr_aton(CONFIG_WIFI_STATIC_IP_NETMASK, &ip_info.netmask);
+    ip4addr_aton(CONFIG_WIFI_STATIC_IP_GATEWAY, &ip_info.gw);
+    IP_ADDR4(&dns_info.ip, 0, 0, 0, 0);
+    ip4addr_aton(CONFIG_WIFI_STATIC_IP_DNS, ip_2_ip4(&dns_info.ip));
+#else
+    time_t now = 0;
+    time(&now);
+    if (fast == false || CACHED_IP_LIFETIME == 0 || now - cache.leased >= CACHED_IP_LIFETIME) {
+        // may have been stopped by previous connection with cached address
+        tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+        return false;
+    }
+    ip_info = cache.ip_info;
+    dns_info = cache.dns_info;
+#endif
+    tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+    tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &ip_info);
+    tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &dns_info);
+    return true;
+}
+
+#if CONFIG_WIFI_FAST_RECONNECT
+static void wifi_save_cache(system_event_t *event)
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        cache.valid = false;
+        return;
+    }
+    memcpy(cache.bssid, ap_info.bssid, sizeof(cache.bssid));
+    cache.channel = ap_info.primary;
+    if (dhcp_used) {
+        cache.ip_info = event->event_info.got_ip.ip_info;
+        tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &cache.dns_info);
+        time(&cache.leased);
+    }
+    cache.valid = true;
+}
+#endif
+
+static void wifi_account_connect(void)
+{
+    uint32_t connect_time = esp_log_timestamp() - connect_start;
+
+    connect_timed = true;
+    if (fast_connect) {
+        stats.fast_connects++;
+        stats.fast_time_ms += connect_time;
+    } else {
+        stats.full_connects++;
+        stats.full_time_ms += connect_time;
+    }
+    ESP_LOGI(TAG, "Connected in %u ms (%s)", connect_time, fast_connect ? "fast" : "full");
+}
+
 static esp_err_t event_handler(void *ctx, system_event_t *event)
 {
     switch(event->event_id) {
@@ -46,12 +160,34 @@ static esp_err_t event_handler(void *ctx, system_event_t *event)
         esp_wifi_connect();
         break;
     case SYSTEM_EVENT_STA_GOT_IP:
+        if (connect_timed == false) {
+            wifi_account_connect();
+#if CONFIG_WIFI_FAST_RECONNECT
+            wifi_save_cache(event);
+#endif
+        }
         xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
         break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
+        if (fast_connect && connect_timed == false) {
+            // access point may have changed, scan and run DHCP again
+            ESP_LOGW(TAG, "Fast connect failed, reason %d", event->event_info.disconnected.reason);
+            fast_connect = false;
+            cache.valid = false;
+            stats.fallbacks++;
+            wifi_set_station_config(false);
+#if !CONFIG_WIFI_STATIC_IP
+            if (dhcp_used == false) {
+                dhcp_used = true;
+                tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+            }
+#endif
+        }
         /* This is a workaround as ESP32 WiFi libs don't currently
            auto-reassociate. */
-        esp_wifi_connect();
+        if (radio_on) {
+            esp_wifi_connect();
+        }
         xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
         break;
     default:
@@ -60,29 +196,61 @@ static esp_err_t event_handler(void *ctx, system_event_t *event)
     return ESP_OK;
 }
 
-void initialise_wifi(void)
+/**
+@brief Start Wi-Fi and wait until connected with IP address
+
+Initialization is done on the first call only,
+so it may be called again to reconnect after wifi_stop().
+
+@param timeout_ms time [ms] to wait for connection
+
+@return
+    - ESP_OK - connected
+    - ESP_ERR_TIMEOUT - not connected within timeout, Wi-Fi is stopped to save power
+*/
+esp_err_t initialise_wifi(uint32_t timeout_ms)
 {
     ESP_LOGI(TAG, "Initialising");
-    tcpip_adapter_init();
-    wifi_event_group = xEventGroupCreate();
-    ESP_ERROR_CHECK( esp_event_loop_init(event_handler, NULL) );
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
-    ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = EXAMPLE_WIFI_SSID,
-            .password = EXAMPLE_WIFI_PASS,
-        },
-    };
-    ESP_LOGI(TAG, "Setting SSID %s...", wifi_config.sta.ssid);
-    ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK( esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) );
+    connect_start = esp_log_timestamp();
+    connect_timed = false;
+    if (wifi_event_group == NULL) {
+        tcpip_adapter_init();
+        wifi_event_group = xEventGroupCreate();
+        ESP_ERROR_CHECK( esp_event_loop_init(event_handler, NULL) );
+        wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+        ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
+        ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
+        ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
+    }
+#if CONFIG_WIFI_FAST_RECONNECT
+    fast_connect = cache.valid;
+#endif
+    wifi_set_station_config(fast_connect);
+    dhcp_used = !wifi_set_ip(fast_connect);
+    ESP_LOGI(TAG, "Connecting %s, %s", fast_connect ? "to cached BSSID" : "with scan", dhcp_used ? "DHCP" : "IP address set");
+    radio_on = true;
     ESP_ERROR_CHECK( esp_wifi_start() );
 
-    xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, timeout_ms / portTICK_RATE_MS);
+    if ((bits & CONNECTED_BIT) == 0) {
+        stats.timeouts++;
+        ESP_LOGW(TAG, "Not connected within %u ms", timeout_ms);
+        wifi_stop();
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
 }
 
+void wifi_stop(void)
+{
+    if (radio_on == false) {
+        return;
+    }
+    radio_on = false;
+    esp_wifi_stop();
+    xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
+    ESP_LOGI(TAG, "Stopped");
+}
 
 /**
 @brief Check if Wi-Fi connection is alive
@@ -94,6 +262,9 @@ ToDo: Check if we have internet connectivity available
 */
 bool network_is_alive(void)
 {
+    if (wifi_event_group == NULL) {
+        return false;
+    }
     EventBits_t uxBits = xEventGroupGetBits(wifi_event_group);
     if (uxBits & CONNECTED_BIT) {
         return true;
@@ -101,3 +272,30 @@ bool network_is_alive(void)
         return false;
     }
 }
+
+/**
+@brief Turn modem sleep on or off
+
+With modem sleep the radio is powered down between DTIM beacons
+and the connection to the access point is retained.
+*/
+void wifi_set_modem_sleep(bool enable)
+{
+    esp_err_t err = esp_wifi_set_ps(enable ? WIFI_PS_MODEM : WIFI_PS_NONE);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Power save mode change failed err=%d", err);
+    }
+}
+
+void wifi_get_connect_stats(wifi_connect_stats* connect_stats)
+{
+    *connect_stats = stats;
+}
+
+void wifi_log_connect_stats(void)
+{
+    ESP_LOGI(TAG, "Fast connects %lu, avg %lu ms, full connects %lu, avg %lu ms, fallbacks %lu, timeouts %lu",
+        stats.fast_connects, stats.fast_connects ? stats.fast_time_ms / stats.fast_connects : 0,
+        stats.full_connects, stats.full_connects ? stats.full_time_ms / stats.full_connects : 0,
+        stats.fallbacks, stats.timeouts);
+}
@@ -15,13 +15,30 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
 #include "freertos/event_groups.h"
 
 extern EventGroupHandle_t wifi_event_group;
 extern const int CONNECTED_BIT;
 
-void initialise_wifi(void);
+// Connection statistics are retained in deep sleep
+typedef struct {
+    unsigned long fast_connects;  /*!< Connections with cached BSSID, channel and IP address */
+    unsigned long fast_time_ms;  /*!< Total time [ms] from start of Wi-Fi to IP address of fast connections */
+    unsigned long full_connects;  /*!< Connections with scan and DHCP, including fallbacks */
+    unsigned long full_time_ms;  /*!< Total time [ms] from start of Wi-Fi to IP address of full connections */
+    unsigned long fallbacks;  /*!< Fast connections that failed and continued with scan and DHCP */
+    unsigned long timeouts;  /*!< Connections not established within timeout */
+} wifi_connect_stats;
+
+esp_err_t initialise_wifi(uint32_t timeout_ms);
+void wifi_stop(void);
 bool network_is_alive(void);
+void wifi_set_modem_sleep(bool enable);
+void wifi_get_connect_stats(wifi_connect_stats* connect_stats);
+void wifi_log_connect_stats(void);
 
 #ifdef __cplusplus
 }
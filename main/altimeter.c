@@ -10,20 +10,40 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
 #include "esp_system.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_clk.h"
+#include "soc/rtc.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
 #include "driver/gpio.h"
 #include "altimeter.h"
+#include "altitude_buffer.h"
+#include "sample_scheduler.h"
+#include "reference_history.h"
+#include "boot_profile.h"
+#include "energy.h"
+#include "pressure_sensor.h"
 #include "bmp180.h"
+#include "twi.h"
 #include "wifi.h"
 #include "weather.h"
 #include "thingspeak.h"
+#if CONFIG_ALTIMETER_WAKE_STUB
+#include "wake_stub.h"
+#endif
 
 static const char* TAG = "Altimeter";
 
@@ -33,21 +53,107 @@ static const char* TAG = "Altimeter";
 #define I2C_PIN_SCL 27
 
 // reference pressure retrieval
-#define WEATHER_DATA_RETREIVAL_PERIOD 60000
 RTC_DATA_ATTR static unsigned long reference_pressure = 0l;
+#define STANDARD_PRESSURE 101325l  // Pressure [Pa] at the sea level assumed if reference is not available
+
+/* Startup pipeline
+   Sensor and network (Wi-Fi, then weather and ThingSpeak clients)
+   are brought up by concurrent stages that report completion with these bits.
+   Sample is recorded as soon as sensor reading is in, while upload waits
+   for reference pressure and network until startup deadline passes,
+   so time awake is set by the slowest stage instead of the sum of all of them.
+ */
+#define STARTUP_DEADLINE CONFIG_ALTIMETER_STARTUP_DEADLINE
+static EventGroupHandle_t startup_events = NULL;
+#define SENSOR_DONE_BIT  BIT0  // Sensor reading is complete or sensor failed
+#define NETWORK_DONE_BIT BIT1  // Wi-Fi is connected and clients initialized
+#define REFERENCE_BIT    BIT2  // Reference pressure is up to date
+#define RADIO_BUDGET_BIT BIT3  // Radio has been on for the budget, Wi-Fi is to be stopped
+
+static bool reference_due;  // Retrieve reference pressure on this boot
+static esp_err_t network_err = ESP_FAIL;
+static bool network_clients_started = false;
+
+/* Offline mode
+   If Wi-Fi does not connect within radio budget, samples are buffered
+   and next connection is attempted after back off time,
+   that doubles with each failed attempt
+ */
+#define RADIO_BUDGET CONFIG_ALTIMETER_RADIO_BUDGET
+#if STARTUP_DEADLINE <= RADIO_BUDGET
+#error "Startup deadline should be longer than radio budget, so Wi-Fi connection completes before it"
+#endif
+#define OFFLINE_BACKOFF_MIN CONFIG_ALTIMETER_OFFLINE_BACKOFF_MIN
+#define OFFLINE_BACKOFF_MAX CONFIG_ALTIMETER_OFFLINE_BACKOFF_MAX
+RTC_DATA_ATTR static unsigned int offline_backoff = 0;  // Time [s] between connection attempts, 0 - online
+RTC_DATA_ATTR static time_t offline_retry_time = 0;
+static esp_err_t sensor_err;
+static pressure_sensor_data sensor_sample;
 
 // Discriminate altitude changes
 // to calculate cumulative altitude climbed
 #define ALTITUDE_DISRIMINATION 1.5
 
-// Altitude measurement data to retain during deep sleep
-RTC_DATA_ATTR static float altitude_climbed = 0.0;
-RTC_DATA_ATTR static float altitude_last;  // last measurement for cumulative calculations
+/* Altitude climbed is accumulated when records are uploaded,
+   once their altitude is computed against reference pressure
+   interpolated between updates that bracket each record
+ */
+typedef struct {
+    bool primed;  /*!< Altitude of the last uploaded record is known */
+    float altitude_last;  /*!< Altitude [meters] of the last uploaded record */
+    float altitude_climbed;  /*!< Total altitude [meters] climbed */
+} climb_state;
+RTC_DATA_ATTR static climb_state climb = {0};
+
+/* The last measurement to adapt sampling to altitude changes
+   Calculated against standard pressure, so it does not jump on reference updates
+ */
+RTC_DATA_ATTR static float altitude_last;
+
+/* Adaptive resolution (oversampling) of pressure measurement
+   Average absolute altitude change between samples reflects
+   both climb rate and measurement noise. When it stays small
+   for RESTING_SAMPLE_COUNT samples, the wearer is resting
+   and faster, less power hungry mode is good enough.
+   Return to the highest resolution as soon as climbing resumes.
+ */
+#define RESOLUTION_CLIMBING PRESSURE_SENSOR_ULTRA_HIGH_RES
+#define RESOLUTION_RESTING PRESSURE_SENSOR_STANDARD
+#define RESTING_ALTITUDE_CHANGE 0.5
+#define RESTING_SAMPLE_COUNT 4
+RTC_DATA_ATTR static uint8_t resolution = RESOLUTION_CLIMBING;
+RTC_DATA_ATTR static float altitude_change_avg = 0.0;
+RTC_DATA_ATTR static unsigned int resting_count = 0;
+
+/* Batched upload of samples retained in RTC memory
+   Upload when UPLOAD_SAMPLES samples have been taken since last attempt,
+   or more often once buffer fills up, e.g. because previous uploads failed
+ */
+#define UPLOAD_SAMPLES CONFIG_ALTIMETER_UPLOAD_SAMPLES
+#define UPLOAD_FILL_THRESHOLD (ALTITUDE_BUFFER_SIZE * 3 / 4)
+RTC_DATA_ATTR static unsigned int samples_since_upload = 0;
 
-// Deep sleep period in seconds
-#define DEEP_SLEEP_PERIOD 15
+/* Time between samples, spent in deep sleep or running in persistent mode,
+   and reference pressure refresh interval adapt to vertical speed
+ */
+static const sample_scheduler_config scheduler_config = {
+    .altitude_step = CONFIG_ALTIMETER_CLIMB_STEP,
+    .period_min = CONFIG_ALTIMETER_SAMPLE_PERIOD_MIN,
+    .period_max = CONFIG_ALTIMETER_SAMPLE_PERIOD_MAX,
+    .refresh_min = CONFIG_ALTIMETER_REFERENCE_REFRESH_MIN,
+    .refresh_max = CONFIG_ALTIMETER_REFERENCE_REFRESH_MAX
+};
+RTC_DATA_ATTR static sample_scheduler scheduler;
+RTC_DATA_ATTR static bool scheduler_initialized = false;
+static unsigned int sample_elapsed;  // Time [s] since previous sample
 RTC_DATA_ATTR static unsigned long boot_count = 0l;
 
+/* Reference pressure is updated by weather data retrieval task,
+   while scheduler and reference history are used by main task,
+   so they are accessed holding this lock
+ */
+static SemaphoreHandle_t reference_lock = NULL;
+
 static int blink_delay = 1000;
 
 void intit_blink_leds()
@@ -64,10 +170,59 @@ void weather_data_retreived(uint32_t *args)
 {
     weather_data* weather = (weather_data*) args;
 
-    reference_pressure = (unsigned long) (weather->pressure * 100);
-    ESP_LOGI(TAG, "Reference pressure: %lu Pa", reference_pressure);
+    unsigned long reference_new = (unsigned long) (weather->pressure * 100);
+    time_t now = 0;
+    time(&now);
+    xSemaphoreTake(reference_lock, portMAX_DELAY);
+    sample_scheduler_reference_updated(&scheduler, reference_pressure, reference_new);
+    reference_pressure = reference_new;
+    reference_history_add((uint32_t) now, reference_pressure);
+    unsigned int refresh_interval = scheduler.refresh_interval;
+    xSemaphoreGive(reference_lock);
+    ESP_LOGI(TAG, "Reference pressure: %lu Pa, next refresh in %u s", reference_new, refresh_interval);
+#if CONFIG_ALTIMETER_PERSISTENT
+    update_weather_data_retrieval(refresh_interval * 1000);
+#endif
+    xEventGroupSetBits(startup_events, REFERENCE_BIT);
+}
+
+// Epoch of the latest reference pressure, to save with a new sample
+uint16_t current_reference_epoch()
+{
+    xSemaphoreTake(reference_lock, portMAX_DELAY);
+    uint16_t epoch = reference_history_epoch();
+    xSemaphoreGive(reference_lock);
+    return epoch;
+}
+
+/* Module up time [s] since power on, counted by RTC timer that keeps running in deep sleep,
+   so records are timed with the same clock whether or not calendar time is set
+ */
+unsigned long module_up_time()
+{
+    return (unsigned long) (rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get()) / 1000000);
 }
 
+void adapt_resolution(float altitude_delta)
+{
+    float altitude_change = fabsf(altitude_delta);
+
+    // exponentially weighted moving average over last few samples
+    altitude_change_avg += (altitude_change - altitude_change_avg) / 4;
+
+    if (altitude_change > ALTITUDE_DISRIMINATION || altitude_change_avg > RESTING_ALTITUDE_CHANGE) {
+        resting_count = 0;
+        if (resolution != RESOLUTION_CLIMBING) {
+            ESP_LOGI(TAG, "Climbing, switching to resolution %d", RESOLUTION_CLIMBING);
+        }
+        resolution = RESOLUTION_CLIMBING;
+    } else if (++resting_count >= RESTING_SAMPLE_COUNT) {
+        if (resolution != RESOLUTION_RESTING) {
+            ESP_LOGI(TAG, "Resting, switching to resolution %d", RESOLUTION_RESTING);
+        }
+        resolution = RESOLUTION_RESTING;
+    }
+}
 
 /*
    Blink LED over the period
@@ -85,30 +240,82 @@ void blink_task(void *pvParameter)
     }
 }
 
-void measure_altitude()
+// Adapt resolution to altitude change and sample period to vertical speed
+void account_altitude(uint32_t pressure, unsigned int elapsed)
+{
+    float altitude = pressure_sensor_altitude(pressure, STANDARD_PRESSURE);
+    float altitude_delta = altitude - altitude_last;
+    adapt_resolution(altitude_delta);
+    altitude_last = altitude;
+    xSemaphoreTake(reference_lock, portMAX_DELAY);
+    sample_scheduler_update(&scheduler, altitude, elapsed);
+    xSemaphoreGive(reference_lock);
+}
+
+#if CONFIG_ALTIMETER_WAKE_STUB
+/* Account for samples taken by wake stub since last boot,
+   so altitude climbed includes them. Samples are compensated
+   with calibration retained in RTC memory, so they are kept
+   even if sensor fails to initialize on this boot.
+   The last sample of the stub is taken just before boot, back to back
+   with sample of the application, so it is dropped if 'replace_last' is set.
+ */
+void process_wake_stub_samples(bool replace_last)
+{
+    bmp180_raw_batch batch;
+    size_t count = wake_stub_samples(&batch);
+    if (count == 0) {
+        return;
+    }
+    if (bmp180_calibration_valid() == false) {
+        ESP_LOGE(TAG, "Calibration lost, dropping %u wake stub samples", (unsigned int) count);
+        return;
+    }
+    bmp180_calibration calibration;
+    bmp180_get_calibration(&calibration);
+    bmp180_data samples[WAKE_STUB_MAX_SAMPLES];
+    bmp180_compensate_batch(&calibration, &batch, samples, count);
+    time_t now = 0;
+    time(&now);
+    unsigned long up_time = module_up_time();
+    uint16_t reference_epoch = current_reference_epoch();
+    size_t kept = replace_last ? count - 1 : count;
+    for (size_t i = 0; i < kept; i++) {
+        altitude_data altitude_record = {0};
+        altitude_record.pressure = samples[i].pressure;
+        altitude_record.temperature = samples[i].temperature;
+        altitude_record.reference_epoch = reference_epoch;
+        account_altitude(samples[i].pressure, sample_elapsed);
+        // the last sample has been taken just before boot
+        altitude_record.timestamp = now - (count - 1 - i) * sample_elapsed;
+        altitude_record.up_time = up_time - (count - 1 - i) * sample_elapsed;
+        altitude_buffer_put(&altitude_record);
+    }
+    samples_since_upload += kept;
+    energy_count_samples(kept);
+    // stub went back to deep sleep after each of its samples but the last one
+    energy_add(ENERGY_DEEP_SLEEP, wake_stub_sleeps() * sample_elapsed * 1000);
+    if (replace_last == false) {
+        // application samples right after the last sample of the stub
+        sample_elapsed = 1;
+    }
+    ESP_LOGI(TAG, "Wake stub samples %u, kept %u, last pressure %u Pa", (unsigned int) count, (unsigned int) kept, samples[count - 1].pressure);
+}
+#endif
+
+/* Save the sample for upload with epoch of the latest reference pressure,
+   altitude is compensated with reference pressure when uploading
+ */
+void record_altitude(const pressure_sensor_data* sample)
 {
     altitude_data altitude_record = {0};
 
-    ESP_LOGI(TAG, "Now measuring altitude");
-    altitude_record.pressure = (unsigned long) bmp180_read_pressure();
-    altitude_record.temperature = bmp180_read_temperature();
-    /* Compensate altitude measurement
-       using current reference pressure, preferably at the sea level,
-       obtained from weather station on internet
-       Assume normal air pressure at sea level of 101325 Pa
-       in case weather station is not available.
-     */
-    altitude_record.reference_pressure = reference_pressure;
-    altitude_record.altitude = bmp180_read_altitude(reference_pressure);
-    ESP_LOGI(TAG, "Altitude %0.1f m", altitude_record.altitude);
+    altitude_record.pressure = (unsigned long) sample->pressure;
+    altitude_record.temperature = sample->temperature;
+    altitude_record.reference_epoch = current_reference_epoch();
+    ESP_LOGI(TAG, "Pressure %u Pa", sample->pressure);
 
-    float altitude_delta = altitude_record.altitude - altitude_last;
-    if (altitude_delta > ALTITUDE_DISRIMINATION) {
-        altitude_climbed += altitude_delta;
-        ESP_LOGD(TAG, "Altitude climbed  %0.1f m", altitude_climbed);
-    }
-    altitude_last = altitude_record.altitude;
-    altitude_record.altitude_climbed = altitude_climbed;
+    account_altitude(sample->pressure, sample_elapsed);
 
     time_t now = 0;
     if (time(&now) == -1) {
@@ -116,72 +323,442 @@ void measure_altitude()
     } else {
         altitude_record.timestamp = now;
     }
-    // ToDo: Calculate module up time
-    // in case time is synchronized with NTP server
-    // altitude_record.up_time = esp_log_timestamp()/1000l;
-    altitude_record.up_time = (unsigned long) now;
+    altitude_record.up_time = module_up_time();
 
-    if (network_is_alive() == true) {
-            thinkgspeak_post_data(&altitude_record);
-    } else {
-        ESP_LOGW(TAG, "Wi-Fi connection is missing");
+    altitude_buffer_put(&altitude_record);
+    samples_since_upload++;
+    energy_count_samples(1);
+}
+
+void measure_altitude()
+{
+    pressure_sensor_data sample;
+
+    ESP_LOGI(TAG, "Now measuring altitude");
+    esp_err_t err = pressure_sensor_read_sample(STANDARD_PRESSURE, &sample);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s read failed with error = %d", pressure_sensor_name(), err);
+        return;
     }
+    record_altitude(&sample);
 }
 
-void app_main()
+/* Compensate altitude of records using reference pressure,
+   preferably at the sea level, obtained from weather station on internet,
+   and interpolated between updates that bracket each record.
+   Assume normal air pressure at sea level
+   in case weather station has not been available.
+ */
+void resolve_altitude(altitude_data* records, size_t count, climb_state* state)
 {
-    ESP_LOGI(TAG, "Starting");
+    xSemaphoreTake(reference_lock, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        records[i].reference_pressure = reference_history_at(records[i].reference_epoch, (uint32_t) records[i].timestamp);
+    }
+    xSemaphoreGive(reference_lock);
 
-    boot_count++;
-    ESP_LOGI(TAG, "Boot count: %lu", boot_count);
+    for (size_t i = 0; i < count; i++) {
+        unsigned long reference = records[i].reference_pressure;
+        if (reference == 0l) {
+            reference = STANDARD_PRESSURE;
+        }
+        records[i].reference_pressure = reference;
+        records[i].altitude = pressure_sensor_altitude(records[i].pressure, reference);
+        float altitude_delta = records[i].altitude - state->altitude_last;
+        if (state->primed && altitude_delta > ALTITUDE_DISRIMINATION) {
+            state->altitude_climbed += altitude_delta;
+        }
+        state->primed = true;
+        state->altitude_last = records[i].altitude;
+        records[i].altitude_climbed = state->altitude_climbed;
+    }
+    ESP_LOGD(TAG, "Altitude climbed  %0.1f m", state->altitude_climbed);
+}
 
-    intit_blink_leds();
+// Check if upload is due, counting in 'new_samples' about to be taken
+bool upload_is_due(unsigned int new_samples)
+{
+    return samples_since_upload + new_samples >= UPLOAD_SAMPLES
+        || altitude_buffer_count() + new_samples >= UPLOAD_FILL_THRESHOLD;
+}
 
-    xTaskCreate(&blink_task, "blink_task", 512, NULL, 5, NULL);
-    ESP_LOGI(TAG, "Blink task started");
+/* Upload all buffered samples in one request
+   Samples stay in the buffer if upload fails
+ */
+void upload_samples()
+{
+    if ((xEventGroupGetBits(startup_events) & NETWORK_DONE_BIT) == 0 || network_is_alive() == false) {
+        ESP_LOGW(TAG, "Wi-Fi connection is missing");
+        return;
+    }
+    // upload interval restarts only when connected, so offline samples count towards the next attempt
+    samples_since_upload = 0;
+    size_t count = altitude_buffer_count();
+    if (count == 0) {
+        return;
+    }
+    altitude_data* records = malloc(count * sizeof(altitude_data));
+    if (records == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for %u samples", (unsigned int) count);
+        return;
+    }
+    altitude_buffer_peek(records, count);
+    // records that fail to upload are resolved again, possibly with better reference
+    climb_state climb_uploaded = climb;
+    resolve_altitude(records, count, &climb_uploaded);
+    esp_err_t err = thinkgspeak_post_batch(records, count);
+    if (err == ESP_OK) {
+        altitude_buffer_drop(count);
+        climb = climb_uploaded;
+        ESP_LOGI(TAG, "Altitude %0.1f m, climbed %0.1f m", climb.altitude_last, climb.altitude_climbed);
+    } else {
+        ESP_LOGW(TAG, "Upload of %u samples failed with error = %d", (unsigned int) count, err);
+    }
+    free(records);
+    if (altitude_buffer_overwritten() > 0) {
+        ESP_LOGW(TAG, "Samples lost due to full buffer: %lu", altitude_buffer_overwritten());
+    }
+}
 
-    nvs_flash_init();
-    initialise_wifi();
+/* Sensor stage
+   Read sample with conversion started right after initialization,
+   leaving altitude calculation until reference pressure is known
+ */
+void sensor_stage(void *pvParameter)
+{
+    boot_profile_begin(BOOT_PHASE_SENSOR);
+    sensor_err = pressure_sensor_init(I2C_PIN_SDA, I2C_PIN_SCL);
+    if (sensor_err == ESP_OK) {
+        pressure_sensor_set_resolution(resolution);
+        sensor_err = pressure_sensor_start();
+    }
+    boot_profile_end(BOOT_PHASE_SENSOR);
+    if (sensor_err == ESP_OK) {
+        boot_profile_begin(BOOT_PHASE_MEASURE);
+        sensor_err = pressure_sensor_read_sample(STANDARD_PRESSURE, &sensor_sample);
+        boot_profile_end(BOOT_PHASE_MEASURE);
+    }
+    xEventGroupSetBits(startup_events, SENSOR_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+void network_failed()
+{
+    time_t now = 0;
+    time(&now);
+    offline_backoff = (offline_backoff == 0) ? OFFLINE_BACKOFF_MIN : offline_backoff * 2;
+    if (offline_backoff > OFFLINE_BACKOFF_MAX) {
+        offline_backoff = OFFLINE_BACKOFF_MAX;
+    }
+    offline_retry_time = now + offline_backoff;
+    ESP_LOGW(TAG, "Offline, next connection attempt in %u s", offline_backoff);
+}
+
+bool network_retry_due()
+{
+    time_t now = 0;
+    time(&now);
+    return offline_backoff == 0 || now >= offline_retry_time;
+}
+
+/* Connect to Wi-Fi within radio budget, then start retrieval of reference pressure,
+   that completes with REFERENCE_BIT set by weather_data_retreived(),
+   and posting to ThingSpeak
+ */
+esp_err_t network_connect()
+{
+    boot_profile_begin(BOOT_PHASE_WIFI);
+    energy_set_state(ENERGY_RADIO);
+    esp_err_t err = initialise_wifi(RADIO_BUDGET);
+    boot_profile_end(BOOT_PHASE_WIFI);
+    if (err != ESP_OK) {
+        energy_set_state(ENERGY_CPU);
+        network_failed();
+        return err;
+    }
+    if (offline_backoff != 0) {
+        ESP_LOGI(TAG, "Back online");
+        offline_backoff = 0;
+    }
+    if (network_clients_started) {
+        return ESP_OK;
+    }
+    network_clients_started = true;
 
     blink_delay= 500;
 
-    if (reference_pressure == 0l || boot_count % 3 == 0) {
-        initialise_weather_data_retrieval(WEATHER_DATA_RETREIVAL_PERIOD);
+    // in persistent mode retrieval task keeps refreshing reference pressure
+    if (reference_due) {
+        initialise_weather_data_retrieval(scheduler.refresh_interval * 1000);
         on_weather_data_retrieval(weather_data_retreived);
         ESP_LOGW(TAG, "Weather data retrieval initialized");
     }
 
     thinkgspeak_initialise();
     ESP_LOGI(TAG, "Posting to ThingSpeak initialized");
+    return ESP_OK;
+}
 
-    int count_down = 5;
-    // first time update of reference pressure
-    if (reference_pressure == 0l) {
-        ESP_LOGI(TAG, "Waiting for reference pressure update...");
-        while (1) {
-            ESP_LOGI(TAG, "Waiting %d", count_down);
-            vTaskDelay(1000 / portTICK_RATE_MS);
-            if (reference_pressure != 0) {
-                ESP_LOGI(TAG, "Update received");
-                break;
-            }
-            if (--count_down == 0) {
-                reference_pressure = 101325l;
-                ESP_LOGW(TAG, "Exit waiting. Assumed standard pressure at the sea level");
-                break;
+#if !CONFIG_ALTIMETER_PERSISTENT
+// Runs on timer service task, so leave stopping of Wi-Fi to main task
+void radio_budget_expired(TimerHandle_t timer)
+{
+    xEventGroupSetBits(startup_events, RADIO_BUDGET_BIT);
+}
+
+/* Stop Wi-Fi if radio budget is used up
+   Called from main task once network stage is done,
+   so it does not race with Wi-Fi connection timeout of the stage
+ */
+void radio_budget_enforce()
+{
+    if (xEventGroupGetBits(startup_events) & RADIO_BUDGET_BIT) {
+        ESP_LOGW(TAG, "Radio on for %d ms, stopping Wi-Fi", RADIO_BUDGET);
+        wifi_stop();
+        energy_set_state(ENERGY_CPU);
+    }
+}
+#endif
+
+// Network stage
+void network_stage(void *pvParameter)
+{
+    nvs_flash_init();
+#if !CONFIG_ALTIMETER_PERSISTENT
+    // radio stays on only for the budget, whatever it is doing
+    TimerHandle_t budget_timer = xTimerCreate("radio_budget", RADIO_BUDGET / portTICK_RATE_MS, pdFALSE, NULL, radio_budget_expired);
+    if (budget_timer != NULL) {
+        xTimerStart(budget_timer, 0);
+    }
+#endif
+    network_err = network_connect();
+    xEventGroupSetBits(startup_events, NETWORK_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+/* Wait for 'bits' until startup deadline counted from 'wait_start',
+   or until radio budget is used up and network stage is done,
+   return true if all of them are set
+ */
+bool wait_for_stages(EventBits_t bits, TickType_t wait_start)
+{
+    TickType_t deadline = STARTUP_DEADLINE / portTICK_RATE_MS;
+    EventBits_t set = xEventGroupGetBits(startup_events);
+    while ((set & bits) != bits) {
+        TickType_t waited = xTaskGetTickCount() - wait_start;
+        if (waited >= deadline) {
+            break;
+        }
+        // once radio budget is used up, only network stage completion is worth waiting for
+        bool budget_used = (set & RADIO_BUDGET_BIT) != 0;
+        if (budget_used && (set & NETWORK_DONE_BIT)) {
+            break;
+        }
+        EventBits_t wake_bits = budget_used ? NETWORK_DONE_BIT : RADIO_BUDGET_BIT;
+        set = xEventGroupWaitBits(startup_events, bits | wake_bits, false, false, deadline - waited);
+    }
+    return (set & bits) == bits;
+}
+
+
+#if CONFIG_ALTIMETER_PERSISTENT
+/*
+   Keep running and take samples with period set by scheduler
+   Between samples Wi-Fi stays connected in modem sleep
+   and CPU goes to automatic light sleep when all tasks are idle.
+   Sensor is initialized once and stays in standby between conversions.
+ */
+void run_persistent(esp_err_t err)
+{
+    // power save mode can be set only once Wi-Fi is initialised
+    bool modem_sleep = (xEventGroupGetBits(startup_events) & NETWORK_DONE_BIT) != 0;
+    if (modem_sleep) {
+        wifi_set_modem_sleep(true);
+    }
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = 40,  // XTAL frequency
+        .light_sleep_enable = true
+    };
+    esp_err_t pm_err = esp_pm_configure(&pm_config);
+    if (pm_err != ESP_OK) {
+        ESP_LOGW(TAG, "Light sleep configuration failed err=%d", pm_err);
+    }
+    // keep CPU at full speed during a sample
+    esp_pm_lock_handle_t sample_lock;
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "sample", &sample_lock);
+#endif
+
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        sample_elapsed = scheduler.period;
+        // light sleep without Wi-Fi is not modelled and accounted as CPU running
+        energy_set_state(network_is_alive() ? ENERGY_MODEM_SLEEP : ENERGY_CPU);
+        vTaskDelayUntil(&last_wake, scheduler.period * 1000 / portTICK_RATE_MS);
+        energy_set_state(ENERGY_CPU);
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_acquire(sample_lock);
+#endif
+        TickType_t sample_start = xTaskGetTickCount();
+        boot_profile_begin(BOOT_PHASE_SENSOR);
+        if (err != ESP_OK) {
+            // sensor failed to start on boot, try again
+            err = pressure_sensor_init(I2C_PIN_SDA, I2C_PIN_SCL);
+        }
+        if (err == ESP_OK) {
+            pressure_sensor_set_resolution(resolution);
+            err = pressure_sensor_start();
+        }
+        boot_profile_end(BOOT_PHASE_SENSOR);
+        if (err == ESP_OK) {
+            gpio_set_level(RED_BLINK_GPIO, 0);
+            boot_profile_begin(BOOT_PHASE_MEASURE);
+            measure_altitude();
+            boot_profile_end(BOOT_PHASE_MEASURE);
+        } else {
+            ESP_LOGE(TAG, "%s start failed with error = %d", pressure_sensor_name(), err);
+            gpio_set_level(RED_BLINK_GPIO, 1);
+        }
+        bool upload_due = upload_is_due(0);
+        if (upload_due && network_is_alive() == false && network_retry_due()) {
+            // restart Wi-Fi, so reconnection attempts are bounded by radio budget
+            wifi_stop();
+            if (network_connect() == ESP_OK && modem_sleep == false) {
+                wifi_set_modem_sleep(true);
+                modem_sleep = true;
             }
         }
+        if (upload_due) {
+            boot_profile_begin(BOOT_PHASE_UPLOAD);
+            energy_set_state(ENERGY_RADIO);
+            upload_samples();
+            energy_set_state(ENERGY_CPU);
+            boot_profile_end(BOOT_PHASE_UPLOAD);
+        }
+        boot_profile_commit();
+        if (upload_due) {
+            boot_profile_log();
+            energy_log();
+        }
+        ESP_LOGI(TAG, "Sample took %u ms", (xTaskGetTickCount() - sample_start) * portTICK_RATE_MS);
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_release(sample_lock);
+#endif
+    }
+}
+#endif  // CONFIG_ALTIMETER_PERSISTENT
+
+void app_main()
+{
+    boot_profile_end(BOOT_PHASE_STARTUP);
+    energy_start();
+    ESP_LOGI(TAG, "Starting");
+
+    boot_count++;
+    ESP_LOGI(TAG, "Boot count: %lu", boot_count);
+
+    reference_lock = xSemaphoreCreateMutex();
+    if (scheduler_initialized == false) {
+        sample_scheduler_init(&scheduler, &scheduler_config);
+        scheduler_initialized = true;
     }
+    // woken up after sleeping for the period set by scheduler
+    sample_elapsed = scheduler.period;
+
+    intit_blink_leds();
 
-    esp_err_t err = bmp180_init(I2C_PIN_SDA, I2C_PIN_SCL);
+    xTaskCreate(&blink_task, "blink_task", 512, NULL, 5, NULL);
+    ESP_LOGI(TAG, "Blink task started");
+
+#if CONFIG_ALTIMETER_PERSISTENT
+    bool network_due = true;
+    reference_due = true;
+#else
+    // bring up Wi-Fi only to upload samples or to get reference pressure
+    unsigned int new_samples = 1;
+#if CONFIG_ALTIMETER_WAKE_STUB
+    // sample of the application replaces the last one of the stub
+    bmp180_raw_batch stub_batch;
+    size_t stub_samples = wake_stub_samples(&stub_batch);
+    if (stub_samples > 0) {
+        new_samples = stub_samples;
+    }
+#endif
+    reference_due = (reference_pressure == 0l || sample_scheduler_reference_due(&scheduler));
+    bool network_due = network_retry_due() && (reference_due || upload_is_due(new_samples));
+#endif
+
+    startup_events = xEventGroupCreate();
+    if (reference_due == false) {
+        xEventGroupSetBits(startup_events, REFERENCE_BIT);
+    }
+    xTaskCreate(&sensor_stage, "sensor_stage", 3 * 1024, NULL, 5, NULL);
+    if (network_due) {
+        xTaskCreate(&network_stage, "network_stage", 4 * 1024, NULL, 5, NULL);
+    }
+
+    /* Sensor reading is bounded by I2C timeouts of the driver,
+       so wait for it with no deadline. Reference pressure is not needed
+       until samples are uploaded.
+     */
+    xEventGroupWaitBits(startup_events, SENSOR_DONE_BIT, false, true, portMAX_DELAY);
+#if CONFIG_ALTIMETER_WAKE_STUB
+    process_wake_stub_samples(sensor_err == ESP_OK);
+#endif
+    esp_err_t err = sensor_err;
     if(err == ESP_OK){
-        measure_altitude();
+        record_altitude(&sensor_sample);
+#if !CONFIG_ALTIMETER_PERSISTENT
+        pressure_sensor_power_down();
+#endif
     } else {
-        ESP_LOGE(TAG, "BMP180 init failed with error = %d", err);
+        ESP_LOGE(TAG, "%s failed with error = %d", pressure_sensor_name(), err);
         gpio_set_level(RED_BLINK_GPIO, 1);
         vTaskDelay(3000);
     }
 
-    ESP_LOGI(TAG, "Entering deep sleep for %d seconds", DEEP_SLEEP_PERIOD);
-    esp_deep_sleep(1000000LL * DEEP_SLEEP_PERIOD);
+    if (network_due) {
+        TickType_t wait_start = xTaskGetTickCount();
+        if (wait_for_stages(NETWORK_DONE_BIT, wait_start) && network_err == ESP_OK) {
+            // wait for reference pressure, so it brackets the latest samples
+            boot_profile_begin(BOOT_PHASE_REFERENCE);
+            if (wait_for_stages(REFERENCE_BIT, wait_start) == false) {
+                ESP_LOGW(TAG, "Reference pressure not received");
+            }
+            boot_profile_end(BOOT_PHASE_REFERENCE);
+#if !CONFIG_ALTIMETER_PERSISTENT
+            radio_budget_enforce();
+#endif
+            boot_profile_begin(BOOT_PHASE_UPLOAD);
+            upload_samples();
+            boot_profile_end(BOOT_PHASE_UPLOAD);
+        } else {
+            if ((xEventGroupGetBits(startup_events) & NETWORK_DONE_BIT) == 0) {
+                // network stage is late, back off as if Wi-Fi failed to connect
+                network_failed();
+            }
+            ESP_LOGW(TAG, "Network not ready. Keeping %u samples until next upload", (unsigned int) altitude_buffer_count());
+        }
+    }
+
+#if CONFIG_ALTIMETER_PERSISTENT
+    run_persistent(err);
+#else
+    twi_log_stats();
+    wifi_log_connect_stats();
+#if CONFIG_ALTIMETER_WAKE_STUB
+    // let the stub take next samples, unless sensor failed
+    wake_stub_arm(I2C_PIN_SDA, I2C_PIN_SCL, resolution, scheduler.period,
+        (err == ESP_OK) ? CONFIG_ALTIMETER_WAKE_STUB_SAMPLES : 0);
+#endif
+    boot_profile_end(BOOT_PHASE_AWAKE);
+    boot_profile_commit();
+    boot_profile_log();
+    energy_deep_sleep(scheduler.period * 1000);
+    energy_log();
+    ESP_LOGI(TAG, "Awake for %u ms", esp_log_timestamp());
+    ESP_LOGI(TAG, "Entering deep sleep for %u seconds", scheduler.period);
+    esp_deep_sleep(1000000LL * scheduler.period);
+#endif
 }
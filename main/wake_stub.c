@@ -0,0 +1,291 @@
+/*
+ wake_stub.c - Sample BMP180 from deep sleep wake stub
+
+ Code of the stub runs from RTC fast memory before the application is loaded,
+ so it may use only ROM functions, register access and data in RTC memory.
+ Therefore I2C is driven directly with GPIO registers and ets_delay_us().
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_deep_sleep.h"
+#include "rom/ets_sys.h"
+#include "rom/rtc.h"
+#include "soc/gpio_reg.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/io_mux_reg.h"
+#include "soc/rtc_cntl_reg.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+
+#include "wake_stub.h"
+
+static const char* TAG = "Wake stub";
+
+#define BMP180_ADDRESS          0x77  // I2C address of BMP180
+#define BMP180_CONTROL          0xF4  // Control register
+#define BMP180_DATA_TO_READ     0xF6  // Read results here
+#define BMP180_READ_TEMP_CMD    0x2E  // Request temperature measurement
+#define BMP180_READ_PRES_CMD    0x34  // Request pressure measurement
+
+#define STUB_TEMP_CONVERSION_US 5000  // Temperature conversion time with margin
+#define STUB_I2C_HALF_PERIOD_US 5  // 100 kHz bus clock
+
+// Configuration of stub set by the application
+RTC_DATA_ATTR static unsigned int stub_samples_left = 0;
+RTC_DATA_ATTR static uint8_t stub_sda;
+RTC_DATA_ATTR static uint8_t stub_scl;
+RTC_DATA_ATTR static uint32_t stub_sda_mux;
+RTC_DATA_ATTR static uint32_t stub_scl_mux;
+// Pull-up of RTC capable pads is in RTC IO register, 0 for other pads
+RTC_DATA_ATTR static uint32_t stub_sda_rtc_reg;
+RTC_DATA_ATTR static uint32_t stub_sda_rtc_pullup;
+RTC_DATA_ATTR static uint32_t stub_scl_rtc_reg;
+RTC_DATA_ATTR static uint32_t stub_scl_rtc_pullup;
+RTC_DATA_ATTR static uint32_t stub_pressure_conversion_us;
+RTC_DATA_ATTR static uint64_t stub_sleep_ticks;  // Deep sleep time in RTC slow clock cycles
+
+// Raw samples taken by the stub
+RTC_DATA_ATTR static unsigned int stub_count = 0;
+RTC_DATA_ATTR static unsigned int stub_sleeps = 0;  // Times stub went back to deep sleep
+RTC_DATA_ATTR static uint8_t stub_oversampling;
+RTC_DATA_ATTR static int16_t stub_ut[WAKE_STUB_MAX_SAMPLES];
+RTC_DATA_ATTR static uint32_t stub_up[WAKE_STUB_MAX_SAMPLES];
+
+
+/* Open drain lines
+   Output level is kept low and line is released (pulled up)
+   or pulled low by disabling or enabling the output
+ */
+static inline void RTC_IRAM_ATTR stub_line(uint8_t pin, bool high)
+{
+    REG_WRITE(high ? GPIO_ENABLE_W1TC_REG : GPIO_ENABLE_W1TS_REG, BIT(pin));
+    ets_delay_us(STUB_I2C_HALF_PERIOD_US);
+}
+
+static inline bool RTC_IRAM_ATTR stub_sda_read(void)
+{
+    return (REG_READ(GPIO_IN_REG) & BIT(stub_sda)) != 0;
+}
+
+/* GPIO configuration is lost in deep sleep, so set the pins up again
+   Internal pull-ups are weak (about 45 kOhm), so external ones
+   are still recommended for reliable 100 kHz operation
+ */
+static void RTC_IRAM_ATTR stub_pin_init(uint8_t pin, uint32_t mux_reg, uint32_t rtc_reg, uint32_t rtc_pullup)
+{
+    PIN_FUNC_SELECT(mux_reg, PIN_FUNC_GPIO);
+    PIN_INPUT_ENABLE(mux_reg);
+    if (rtc_reg != 0) {
+        SET_PERI_REG_MASK(rtc_reg, rtc_pullup);
+    } else {
+        PIN_PULLUP_EN(mux_reg);
+    }
+    REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + pin * 4, SIG_GPIO_OUT_IDX);
+    REG_WRITE(GPIO_OUT_W1TC_REG, BIT(pin));
+    REG_WRITE(GPIO_ENABLE_W1TC_REG, BIT(pin));
+}
+
+static void RTC_IRAM_ATTR stub_i2c_start(void)
+{
+    // also works as repeated start, as SCL is low after previous byte
+    stub_line(stub_sda, true);
+    stub_line(stub_scl, true);
+    stub_line(stub_sda, false);
+    stub_line(stub_scl, false);
+}
+
+static void RTC_IRAM_ATTR stub_i2c_stop(void)
+{
+    stub_line(stub_sda, false);
+    stub_line(stub_scl, true);
+    stub_line(stub_sda, true);
+}
+
+static bool RTC_IRAM_ATTR stub_i2c_write(uint8_t byte)
+{
+    for (int i = 0; i < 8; i++) {
+        stub_line(stub_sda, (byte & 0x80) != 0);
+        stub_line(stub_scl, true);
+        stub_line(stub_scl, false);
+        byte <<= 1;
+    }
+    stub_line(stub_sda, true);
+    stub_line(stub_scl, true);
+    bool ack = !stub_sda_read();
+    stub_line(stub_scl, false);
+    return ack;
+}
+
+static uint8_t RTC_IRAM_ATTR stub_i2c_read(bool ack)
+{
+    uint8_t byte = 0;
+    stub_line(stub_sda, true);
+    for (int i = 0; i < 8; i++) {
+        stub_line(stub_scl, true);
+        byte = (byte << 1) | stub_sda_read();
+        stub_line(stub_scl, false);
+    }
+    stub_line(stub_sda, !ack);
+    stub_line(stub_scl, true);
+    stub_line(stub_scl, false);
+    return byte;
+}
+
+static bool RTC_IRAM_ATTR stub_bmp180_write(uint8_t reg, uint8_t value)
+{
+    stub_i2c_start();
+    bool ack = stub_i2c_write(BMP180_ADDRESS << 1) && stub_i2c_write(reg) && stub_i2c_write(value);
+    stub_i2c_stop();
+    return ack;
+}
+
+// Read 'len' registers from 'reg', combined transaction with repeated start
+static bool RTC_IRAM_ATTR stub_bmp180_read(uint8_t reg, uint8_t* buf, int len)
+{
+    stub_i2c_start();
+    bool ack = stub_i2c_write(BMP180_ADDRESS << 1) && stub_i2c_write(reg);
+    if (ack) {
+        stub_i2c_start();
+        ack = stub_i2c_write((BMP180_ADDRESS << 1) | 1);
+    }
+    if (ack) {
+        for (int i = 0; i < len; i++) {
+            buf[i] = stub_i2c_read(i < len - 1);
+        }
+    }
+    stub_i2c_stop();
+    return ack;
+}
+
+static bool RTC_IRAM_ATTR stub_sample(void)
+{
+    uint8_t data[3];
+
+    stub_pin_init(stub_sda, stub_sda_mux, stub_sda_rtc_reg, stub_sda_rtc_pullup);
+    stub_pin_init(stub_scl, stub_scl_mux, stub_scl_rtc_reg, stub_scl_rtc_pullup);
+
+    if (!stub_bmp180_write(BMP180_CONTROL, BMP180_READ_TEMP_CMD)) {
+        return false;
+    }
+    ets_delay_us(STUB_TEMP_CONVERSION_US);
+    if (!stub_bmp180_read(BMP180_DATA_TO_READ, data, 2)) {
+        return false;
+    }
+    stub_ut[stub_count] = (int16_t) (data[0] << 8 | data[1]);
+
+    if (!stub_bmp180_write(BMP180_CONTROL, BMP180_READ_PRES_CMD + (stub_oversampling << 6))) {
+        return false;
+    }
+    ets_delay_us(stub_pressure_conversion_us);
+    if (!stub_bmp180_read(BMP180_DATA_TO_READ, data, 3)) {
+        return false;
+    }
+    stub_up[stub_count] = ((uint32_t) data[0] << 16 | (uint32_t) data[1] << 8 | data[2]) >> (8 - stub_oversampling);
+    stub_count++;
+    return true;
+}
+
+// Go back to deep sleep for the same time, entering the stub again on wake up
+static void RTC_IRAM_ATTR stub_sleep(void)
+{
+    SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+    while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_VALID) == 0) {
+        ets_delay_us(1);
+    }
+    SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+    uint64_t wake_up = READ_PERI_REG(RTC_CNTL_TIME0_REG);
+    wake_up |= (uint64_t) READ_PERI_REG(RTC_CNTL_TIME1_REG) << 32;
+    wake_up += stub_sleep_ticks;
+    stub_sleeps++;
+    WRITE_PERI_REG(RTC_CNTL_SLP_TIMER0_REG, (uint32_t) wake_up);
+    WRITE_PERI_REG(RTC_CNTL_SLP_TIMER1_REG, (uint32_t) (wake_up >> 32));
+
+    REG_WRITE(RTC_ENTRY_ADDR_REG, (uint32_t) &esp_wake_deep_sleep);
+    set_rtc_memory_crc();
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    while (true) {
+        ;
+    }
+}
+
+/* Replaces default wake stub of esp-idf
+   Boot the application if there is nothing to sample,
+   the sensor does not respond or enough samples are collected
+ */
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+    esp_default_wake_deep_sleep();
+    if (stub_samples_left == 0) {
+        return;
+    }
+    stub_samples_left--;
+    if (stub_sample() == false) {
+        stub_samples_left = 0;
+        return;
+    }
+    if (stub_samples_left == 0) {
+        return;
+    }
+    stub_sleep();
+}
+
+// Table of RTC IO registers is in flash, so copy what the stub needs
+static void stub_rtc_pullup(int pin, uint32_t* reg, uint32_t* pullup)
+{
+    if (rtc_gpio_is_valid_gpio(pin)) {
+        *reg = rtc_gpio_desc[pin].reg;
+        *pullup = rtc_gpio_desc[pin].pullup;
+    } else {
+        *reg = 0;
+        *pullup = 0;
+    }
+}
+
+bool wake_stub_arm(int pin_sda, int pin_scl, uint8_t oversampling, unsigned int period_s, unsigned int samples)
+{
+    stub_samples_left = 0;
+    stub_count = 0;
+    stub_sleeps = 0;
+    if (pin_sda < 0 || pin_sda > 31 || pin_scl < 0 || pin_scl > 31 || samples > WAKE_STUB_MAX_SAMPLES) {
+        ESP_LOGE(TAG, "Pins %d, %d or sample count %u out of range", pin_sda, pin_scl, samples);
+        return false;
+    }
+    stub_sda = pin_sda;
+    stub_scl = pin_scl;
+    stub_sda_mux = GPIO_PIN_MUX_REG[pin_sda];
+    stub_scl_mux = GPIO_PIN_MUX_REG[pin_scl];
+    stub_rtc_pullup(pin_sda, &stub_sda_rtc_reg, &stub_sda_rtc_pullup);
+    stub_rtc_pullup(pin_scl, &stub_scl_rtc_reg, &stub_scl_rtc_pullup);
+    stub_oversampling = oversampling & 0x03;
+    // 4.5, 7.5, 13.5 and 25.5 ms as per datasheet, rounded up
+    stub_pressure_conversion_us = (2 + (3 << stub_oversampling)) * 1000;
+    // calibration of slow clock is period of one cycle [us] in Q13.19 fixed point
+    stub_sleep_ticks = ((uint64_t) period_s * 1000000 << 19) / REG_READ(RTC_SLOW_CLK_CAL_REG);
+    stub_samples_left = samples;
+    ESP_LOGD(TAG, "Armed for %u samples", samples);
+    return true;
+}
+
+size_t wake_stub_samples(bmp180_raw_batch* batch)
+{
+    batch->ut = stub_ut;
+    batch->up = stub_up;
+    batch->reference_pressure = NULL;
+    batch->oversampling = stub_oversampling;
+    return stub_count;
+}
+
+unsigned int wake_stub_sleeps(void)
+{
+    return stub_sleeps;
+}
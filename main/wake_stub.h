@@ -0,0 +1,73 @@
+/*
+ wake_stub.h - Sample BMP180 from deep sleep wake stub
+
+ On timer wake up the stub reads raw temperature and pressure from BMP180,
+ stores them in RTC memory and goes back to deep sleep straight away,
+ without booting the application. The application boots once the stub
+ has taken the number of samples it has been armed for,
+ or if the sensor does not respond.
+
+ SDA and SCL are driven open drain with internal pull-ups enabled,
+ also for RTC capable pads. These are weak, so external pull-up
+ resistors are recommended.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef WAKE_STUB_H
+#define WAKE_STUB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WAKE_STUB_MAX_SAMPLES 32  // Size of raw sample buffer in RTC memory
+
+/**
+@brief Arm wake stub before entering deep sleep
+
+Clears samples taken by wake stub so far.
+
+@param pin_sda GPIO of SDA line, 0 - 31
+@param pin_scl GPIO of SCL line, 0 - 31
+@param oversampling BMP180 oversampling mode for pressure
+@param period_s time [seconds] of deep sleep between samples
+@param samples number of samples to take before booting the application,
+       0 to boot on each wake up
+
+@return
+    - true - stub armed
+    - false - pins or number of samples out of range, stub is not armed
+*/
+bool wake_stub_arm(int pin_sda, int pin_scl, uint8_t oversampling, unsigned int period_s, unsigned int samples);
+
+/**
+@brief Get samples taken by wake stub since it has been armed
+
+Samples stay in RTC memory until stub is armed again.
+
+@param batch set to point to raw samples, ready for bmp180_compensate_batch()
+
+@return number of samples
+*/
+size_t wake_stub_samples(bmp180_raw_batch* batch);
+
+/**
+@brief Number of times wake stub went back to deep sleep since it has been armed
+*/
+unsigned int wake_stub_sleeps(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // WAKE_STUB_H
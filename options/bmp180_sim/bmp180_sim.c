@@ -0,0 +1,310 @@
+/*
+ bmp180_sim.c - Simulated BMP180 pressure sensor behind the twi API
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_log.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "bmp180_sim.h"
+#include "bmp180.h"
+#include "twi.h"
+
+static const char* TAG = "BMP180 sim";
+
+#define BMP180_ADDRESS 0x77  // I2C address of BMP180
+
+#define BMP180_CAL_AC1          0xAA  // First register of calibration data
+#define BMP180_CHIP_ID          0xD0  // Chip id register, reads 0x55
+#define BMP180_SOFT_RESET       0xE0  // Soft reset register
+#define BMP180_CONTROL          0xF4  // Control register
+#define BMP180_DATA_TO_READ     0xF6  // Result registers, MSB, LSB, XLSB
+#define BMP180_READ_TEMP_CMD    0x2E  // Request temperature measurement
+#define BMP180_CONTROL_SCO      0x20  // Start of conversion bit
+
+/* Calibration of the sensor used as example in BMP180 datasheet
+   For UT = 27898 and UP = 23843 (oss = 0)
+   it gives 15.0 deg C and 69964 Pa
+ */
+static const bmp180_calibration sim_calib = {
+    .ac1 = 408, .ac2 = -72, .ac3 = -14383,
+    .ac4 = 32741, .ac5 = 32757, .ac6 = 23153,
+    .b1 = 6190, .b2 = 4,
+    .mb = -32768, .mc = -8711, .md = 2868
+};
+
+// Typical conversion times [ms] as per datasheet
+#define SIM_TEMP_CONVERSION_MS 3
+static const uint8_t sim_pressure_conversion_ms[] = {3, 5, 9, 17};
+
+// RMS noise of pressure [Pa] for each oversampling mode as per datasheet
+static const float sim_pressure_noise[] = {6.0, 5.0, 4.0, 3.0};
+
+static uint8_t regs[256];
+static uint8_t reg_pointer;
+
+static const bmp180_sim_point* sim_trace;
+static size_t sim_trace_count;
+static uint32_t noise_state;
+static TickType_t sim_start;
+
+// Conversion in progress
+static bool converting = false;
+static unsigned long conversion_end_ms;
+static uint32_t conversion_result;
+
+static unsigned int bus_clock = 100000;
+static bmp180_sim_stats stats;
+
+
+static unsigned long sim_time_ms(void)
+{
+    return (xTaskGetTickCount() - sim_start) * portTICK_RATE_MS;
+}
+
+static void sim_trace_at(unsigned long time_ms, float* pressure, float* temperature)
+{
+    size_t i = 0;
+    while (i + 1 < sim_trace_count && sim_trace[i + 1].time_ms <= time_ms) {
+        i++;
+    }
+    const bmp180_sim_point* a = &sim_trace[i];
+    if (i + 1 == sim_trace_count || time_ms <= a->time_ms) {
+        *pressure = a->pressure;
+        *temperature = a->temperature;
+        return;
+    }
+    const bmp180_sim_point* b = &sim_trace[i + 1];
+    float k = (time_ms - a->time_ms) / (float) (b->time_ms - a->time_ms);
+    *pressure = a->pressure + k * ((float) b->pressure - (float) a->pressure);
+    *temperature = a->temperature + k * (b->temperature - a->temperature);
+}
+
+// Deterministic noise of unit RMS, approximately normal distribution
+static float sim_noise(void)
+{
+    if (noise_state == 0) {
+        return 0.0;
+    }
+    float sum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        // xorshift32
+        noise_state ^= noise_state << 13;
+        noise_state ^= noise_state >> 17;
+        noise_state ^= noise_state << 5;
+        sum += (noise_state / 4294967296.0) - 0.5;
+    }
+    return sum * sqrtf(3.0);
+}
+
+/* Find raw reading that compensates to the value closest to 'target'
+   Compensated temperature and pressure both grow with raw reading,
+   so bisection over the range of raw values is enough
+ */
+static uint32_t sim_raw_for(uint8_t oss, bool pressure, float target, int16_t ut)
+{
+    uint32_t low = 0;
+    uint32_t high = pressure ? (1 << (16 + oss)) - 1 : 0x7fff;
+    int16_t raw_ut;
+    uint32_t raw_up;
+    bmp180_raw_batch batch = {
+        .ut = &raw_ut, .up = &raw_up,
+        .reference_pressure = NULL, .oversampling = oss
+    };
+    bmp180_data out;
+
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        raw_ut = pressure ? ut : (int16_t) mid;
+        raw_up = pressure ? mid : 0;
+        bmp180_compensate_batch(&sim_calib, &batch, &out, 1);
+        float value = pressure ? (float) out.pressure : out.temperature;
+        if (value < target) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void sim_start_conversion(uint8_t command)
+{
+    float pressure, temperature;
+    unsigned long now = sim_time_ms();
+
+    sim_trace_at(now, &pressure, &temperature);
+    int16_t ut = (int16_t) sim_raw_for(0, false, temperature, 0);
+
+    if (command == BMP180_READ_TEMP_CMD) {
+        conversion_result = (uint32_t) (uint16_t) ut << 8;
+        conversion_end_ms = now + SIM_TEMP_CONVERSION_MS;
+    } else {
+        uint8_t oss = (command >> 6) & 0x03;
+        pressure += sim_pressure_noise[oss] * sim_noise();
+        conversion_result = sim_raw_for(oss, true, pressure, ut) << (8 - oss);
+        conversion_end_ms = now + sim_pressure_conversion_ms[oss];
+    }
+    converting = true;
+    regs[BMP180_CONTROL] = command | BMP180_CONTROL_SCO;
+    stats.conversions++;
+}
+
+// Result registers are updated once conversion is complete
+static void sim_update(void)
+{
+    if (converting && sim_time_ms() >= conversion_end_ms) {
+        regs[BMP180_DATA_TO_READ] = conversion_result >> 16;
+        regs[BMP180_DATA_TO_READ + 1] = conversion_result >> 8;
+        regs[BMP180_DATA_TO_READ + 2] = conversion_result;
+        regs[BMP180_CONTROL] &= ~BMP180_CONTROL_SCO;
+        converting = false;
+    }
+}
+
+/* Account for single transaction of 'len' bytes including address bytes
+   and 'conditions' start, repeated start and stop conditions
+ */
+static void sim_bus_transfer(unsigned int len, unsigned int conditions)
+{
+    stats.transactions++;
+    stats.bytes += len;
+    // each byte takes 9 clocks with ack bit
+    stats.bus_time_us += (conditions + 9 * len) * 1000000UL / bus_clock;
+}
+
+static void sim_read_registers(uint8_t* buf, unsigned int len)
+{
+    sim_update();
+    if (converting && reg_pointer >= BMP180_DATA_TO_READ && reg_pointer <= BMP180_DATA_TO_READ + 2) {
+        stats.early_reads++;
+    }
+    for (unsigned int i = 0; i < len; i++) {
+        buf[i] = regs[reg_pointer++];
+    }
+}
+
+void bmp180_sim_init(const bmp180_sim_point* trace, size_t count, uint32_t seed)
+{
+    sim_trace = trace;
+    sim_trace_count = count;
+    noise_state = seed;
+    sim_start = xTaskGetTickCount();
+    converting = false;
+    reg_pointer = 0;
+
+    memset(regs, 0, sizeof(regs));
+    const int16_t* calib_words = (const int16_t*) &sim_calib;
+    for (int i = 0; i < sizeof(sim_calib) / sizeof(int16_t); i++) {
+        regs[BMP180_CAL_AC1 + 2 * i] = (uint16_t) calib_words[i] >> 8;
+        regs[BMP180_CAL_AC1 + 2 * i + 1] = (uint16_t) calib_words[i] & 0xff;
+    }
+    regs[BMP180_CHIP_ID] = 0x55;
+
+    bmp180_sim_reset_stats();
+    ESP_LOGD(TAG, "Initialized with %u trace points", (unsigned int) count);
+}
+
+void bmp180_sim_get_stats(bmp180_sim_stats* sim_stats)
+{
+    *sim_stats = stats;
+}
+
+void bmp180_sim_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void twi_init(unsigned char sda, unsigned char scl)
+{
+    twi_setClock(100000);
+}
+
+void twi_stop(void)
+{
+}
+
+void twi_setClock(unsigned int freq)
+{
+    bus_clock = freq;
+}
+
+uint8_t twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    if (address != BMP180_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    sim_bus_transfer(len + 1, 2);
+    sim_update();
+    if (len == 0) {
+        return 0;
+    }
+    reg_pointer = buf[0];
+    for (unsigned int i = 1; i < len; i++) {
+        if (reg_pointer == BMP180_CONTROL) {
+            sim_start_conversion(buf[i]);
+        } else if (reg_pointer == BMP180_SOFT_RESET && buf[i] == 0xB6) {
+            converting = false;
+            regs[BMP180_CONTROL] = 0;
+        }
+        reg_pointer++;
+    }
+    return 0;
+}
+
+uint8_t twi_readFrom(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    if (address != BMP180_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    sim_bus_transfer(len + 1, 2);
+    sim_read_registers(buf, len);
+    return 0;
+}
+
+uint8_t twi_write_read(unsigned char address, unsigned char * wbuf, unsigned int wlen, unsigned char * rbuf, unsigned int rlen)
+{
+    if (rlen == 0) {
+        return twi_writeTo(address, wbuf, wlen, true);
+    }
+    if (address != BMP180_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    // start + write address + data + repeated start + read address + data + stop
+    sim_bus_transfer(wlen + rlen + 2, 3);
+    if (wlen > 0) {
+        reg_pointer = wbuf[0];
+    }
+    sim_read_registers(rbuf, rlen);
+    return 0;
+}
+
+uint8_t twi_scan()
+{
+    uint8_t reg = 0x00;
+    uint8_t device_count = 0;
+
+    for (uint8_t i = 0; i < 127; i++) {
+        if (twi_writeTo(i, &reg, 1, true) == 0) {
+            ESP_LOGD(TAG, "Device found at 0x%02x", i);
+            device_count++;
+        }
+    }
+    return device_count;
+}
@@ -0,0 +1,61 @@
+/*
+ bmp180_sim.h - Simulated BMP180 pressure sensor behind the twi API
+
+ Register model of BMP180 that implements twi_writeTo() / twi_readFrom() / twi_write_read()
+ so the bmp180 driver runs without hardware. Use it instead of
+ twi.c / twi_hw.c of components/twi, keeping twi_bus.c,
+ to test the driver, count bus usage and replay pressure recorded earlier.
+ Host build together with components/bmp180 is in test/Makefile.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef BMP180_SIM_H
+#define BMP180_SIM_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    unsigned long time_ms;  /*!< Time [ms] since bmp180_sim_init() */
+    uint32_t pressure;  /*!< Absolute pressure [Pa] at this time */
+    float temperature;  /*!< Temperature [deg C] at this time */
+} bmp180_sim_point;
+
+typedef struct {
+    unsigned long transactions;  /*!< Number of start conditions on the bus */
+    unsigned long bytes;  /*!< Number of bytes transferred including address bytes */
+    unsigned long nacks;  /*!< Number of transactions not acknowledged by the sensor */
+    unsigned long conversions;  /*!< Number of conversions started */
+    unsigned long early_reads;  /*!< Number of result reads before conversion was complete */
+    unsigned long bus_time_us;  /*!< Estimated time [us] the bus was busy */
+} bmp180_sim_stats;
+
+/**
+@brief Reset the simulated sensor and load pressure trace
+
+Pressure and temperature are linearly interpolated between trace points
+and held constant after the last point.
+Measurement noise is deterministic for given 'seed'.
+
+@param trace array of points sorted by time, at least one point
+@param count number of points in trace
+@param seed seed of noise generator, 0 - no noise
+*/
+void bmp180_sim_init(const bmp180_sim_point* trace, size_t count, uint32_t seed);
+void bmp180_sim_get_stats(bmp180_sim_stats* stats);
+void bmp180_sim_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BMP180_SIM_H
@@ -0,0 +1,427 @@
+/*
+ bmp280_sim.c - Simulated BMP280 pressure sensor behind the twi API
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_log.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "bmp280_sim.h"
+#include "bmp280.h"
+#include "twi.h"
+
+static const char* TAG = "BMP280 sim";
+
+#define BMP280_ADDRESS 0x76  // I2C address of BMP280 with SDO pulled low
+
+#define BMP280_CALIB            0x88  // First register of calibration data
+#define BMP280_CHIP_ID          0xD0  // Chip id register, reads 0x58
+#define BMP280_SOFT_RESET       0xE0  // Soft reset register
+#define BMP280_STATUS           0xF3  // Status register
+#define BMP280_CTRL_MEAS        0xF4  // Oversampling and mode control register
+#define BMP280_CONFIG           0xF5  // Standby time and IIR filter register
+#define BMP280_DATA             0xF7  // Pressure and temperature, MSB, LSB, XLSB each
+
+#define BMP280_STATUS_MEASURING 0x08
+#define BMP280_DATA_SKIPPED     0x80000  // Result of skipped measurement
+
+/* Calibration of the sensor used as example in BMP280 datasheet
+   For adc_T = 519888 and adc_P = 415148
+   it gives 25.08 deg C and 100653 Pa
+ */
+static const bmp280_calibration sim_calib = {
+    .dig_t1 = 27504, .dig_t2 = 26435, .dig_t3 = -1000,
+    .dig_p1 = 36477, .dig_p2 = -10685, .dig_p3 = 3024,
+    .dig_p4 = 2855, .dig_p5 = 140, .dig_p6 = -7,
+    .dig_p7 = 15500, .dig_p8 = -14600, .dig_p9 = 6000
+};
+
+// RMS noise of pressure [Pa] for oversampling x1 to x16, approximately as per datasheet, filter off
+static const float sim_pressure_noise[] = {2.6, 2.1, 1.6, 1.3, 1.0};
+
+static uint8_t regs[256];
+static uint8_t reg_pointer;
+
+static const bmp280_sim_point* sim_trace;
+static size_t sim_trace_count;
+static uint32_t noise_state;
+static TickType_t sim_start;
+
+// Measurement in progress
+static bool measuring = false;
+static unsigned long measurement_end_ms;
+static uint32_t result_adc_p;
+static uint32_t result_adc_t;
+
+// IIR filter state, reset on write of filter configuration
+static bool filter_primed = false;
+static float filtered_adc_p;
+static float filtered_adc_t;
+
+static unsigned int bus_clock = 100000;
+static bmp280_sim_stats stats;
+
+
+static unsigned long sim_time_ms(void)
+{
+    return (xTaskGetTickCount() - sim_start) * portTICK_RATE_MS;
+}
+
+static void sim_trace_at(unsigned long time_ms, float* pressure, float* temperature)
+{
+    size_t i = 0;
+    while (i + 1 < sim_trace_count && sim_trace[i + 1].time_ms <= time_ms) {
+        i++;
+    }
+    const bmp280_sim_point* a = &sim_trace[i];
+    if (i + 1 == sim_trace_count || time_ms <= a->time_ms) {
+        *pressure = a->pressure;
+        *temperature = a->temperature;
+        return;
+    }
+    const bmp280_sim_point* b = &sim_trace[i + 1];
+    float k = (time_ms - a->time_ms) / (float) (b->time_ms - a->time_ms);
+    *pressure = a->pressure + k * ((float) b->pressure - (float) a->pressure);
+    *temperature = a->temperature + k * (b->temperature - a->temperature);
+}
+
+// Deterministic noise of unit RMS, approximately normal distribution
+static float sim_noise(void)
+{
+    if (noise_state == 0) {
+        return 0.0;
+    }
+    float sum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        // xorshift32
+        noise_state ^= noise_state << 13;
+        noise_state ^= noise_state >> 17;
+        noise_state ^= noise_state << 5;
+        sum += (noise_state / 4294967296.0) - 0.5;
+    }
+    return sum * sqrtf(3.0);
+}
+
+/* Compensation as per BMP280 datasheet, kept apart from the driver,
+   so the driver is checked against an independent model of the sensor
+ */
+static int32_t sim_t_fine(int32_t adc_t)
+{
+    int32_t var1 = ((((adc_t >> 3) - ((int32_t) sim_calib.dig_t1 << 1))) * ((int32_t) sim_calib.dig_t2)) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - ((int32_t) sim_calib.dig_t1)) * ((adc_t >> 4) - ((int32_t) sim_calib.dig_t1))) >> 12) *
+            ((int32_t) sim_calib.dig_t3)) >> 14;
+    return var1 + var2;
+}
+
+static float sim_temperature(int32_t adc_t)
+{
+    return ((sim_t_fine(adc_t) * 5 + 128) >> 8) / 100.0;
+}
+
+static float sim_pressure(int32_t adc_p, int32_t t_fine)
+{
+    int64_t var1 = ((int64_t) t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t) sim_calib.dig_p6;
+    var2 = var2 + ((var1 * (int64_t) sim_calib.dig_p5) << 17);
+    var2 = var2 + (((int64_t) sim_calib.dig_p4) << 35);
+    var1 = ((var1 * var1 * (int64_t) sim_calib.dig_p3) >> 8) + ((var1 * (int64_t) sim_calib.dig_p2) << 12);
+    var1 = (((((int64_t) 1) << 47) + var1)) * ((int64_t) sim_calib.dig_p1) >> 33;
+    if (var1 == 0) {
+        return 0.0;
+    }
+    int64_t p = 1048576 - adc_p;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t) sim_calib.dig_p9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t) sim_calib.dig_p8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t) sim_calib.dig_p7) << 4);
+    return p / 256.0;
+}
+
+/* Find 20 bit raw reading that compensates to 'target'
+   Temperature grows and pressure falls with raw reading,
+   so bisection over the range of raw values is enough
+ */
+static uint32_t sim_raw_temperature(float target)
+{
+    uint32_t low = 0, high = 0xfffff;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (sim_temperature(mid) < target) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static uint32_t sim_raw_pressure(float target, int32_t t_fine)
+{
+    uint32_t low = 0, high = 0xfffff;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (sim_pressure(mid, t_fine) > target) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Resolution is 16 bit with oversampling x1 and grows by one bit with each step up to x16
+static uint32_t sim_quantize(uint32_t raw, uint8_t osrs)
+{
+    return raw & ~((1u << (5 - osrs)) - 1);
+}
+
+// Typical measurement time [ms] as per datasheet, 1 + 2 * T samples + 2 * P samples + 0.5
+static unsigned long sim_measurement_time_ms(uint8_t osrs_t, uint8_t osrs_p)
+{
+    unsigned long time_us = 1000;
+    if (osrs_t != BMP280_OVERSAMPLING_SKIP) {
+        time_us += 2000 << (osrs_t - 1);
+    }
+    if (osrs_p != BMP280_OVERSAMPLING_SKIP) {
+        time_us += (2000 << (osrs_p - 1)) + 500;
+    }
+    return (time_us + 999) / 1000;
+}
+
+static void sim_start_measurement(uint8_t ctrl_meas)
+{
+    float pressure, temperature;
+    unsigned long now = sim_time_ms();
+    uint8_t osrs_t = ctrl_meas >> 5;
+    uint8_t osrs_p = (ctrl_meas >> 2) & 0x07;
+    osrs_t = (osrs_t > BMP280_OVERSAMPLING_X16) ? BMP280_OVERSAMPLING_X16 : osrs_t;
+    osrs_p = (osrs_p > BMP280_OVERSAMPLING_X16) ? BMP280_OVERSAMPLING_X16 : osrs_p;
+
+    sim_trace_at(now, &pressure, &temperature);
+    uint32_t adc_t = sim_raw_temperature(temperature);
+    int32_t t_fine = sim_t_fine(adc_t);
+    if (osrs_t == BMP280_OVERSAMPLING_SKIP) {
+        result_adc_t = BMP280_DATA_SKIPPED;
+    } else {
+        result_adc_t = sim_quantize(adc_t, osrs_t);
+    }
+    if (osrs_p == BMP280_OVERSAMPLING_SKIP) {
+        result_adc_p = BMP280_DATA_SKIPPED;
+    } else {
+        pressure += sim_pressure_noise[osrs_p - 1] * sim_noise();
+        result_adc_p = sim_quantize(sim_raw_pressure(pressure, t_fine), osrs_p);
+    }
+
+    uint8_t filter = (regs[BMP280_CONFIG] >> 2) & 0x07;
+    if (filter != BMP280_FILTER_OFF) {
+        if (filter_primed == false) {
+            filtered_adc_p = result_adc_p;
+            filtered_adc_t = result_adc_t;
+            filter_primed = true;
+        }
+        float coefficient = 1 << filter;
+        filtered_adc_p += (result_adc_p - filtered_adc_p) / coefficient;
+        filtered_adc_t += (result_adc_t - filtered_adc_t) / coefficient;
+        result_adc_p = (uint32_t) (filtered_adc_p + 0.5);
+        result_adc_t = (uint32_t) (filtered_adc_t + 0.5);
+    }
+
+    measuring = true;
+    measurement_end_ms = now + sim_measurement_time_ms(osrs_t, osrs_p);
+    regs[BMP280_STATUS] |= BMP280_STATUS_MEASURING;
+    stats.conversions++;
+}
+
+// Result registers are updated and sensor returns to sleep mode once measurement is complete
+static void sim_update(void)
+{
+    if (measuring && sim_time_ms() >= measurement_end_ms) {
+        regs[BMP280_DATA] = result_adc_p >> 12;
+        regs[BMP280_DATA + 1] = result_adc_p >> 4;
+        regs[BMP280_DATA + 2] = (result_adc_p & 0x0f) << 4;
+        regs[BMP280_DATA + 3] = result_adc_t >> 12;
+        regs[BMP280_DATA + 4] = result_adc_t >> 4;
+        regs[BMP280_DATA + 5] = (result_adc_t & 0x0f) << 4;
+        regs[BMP280_STATUS] &= ~BMP280_STATUS_MEASURING;
+        regs[BMP280_CTRL_MEAS] &= ~0x03;
+        measuring = false;
+    }
+}
+
+static void sim_reset(void)
+{
+    measuring = false;
+    filter_primed = false;
+    memset(regs, 0, sizeof(regs));
+    for (int i = 0; i < sizeof(sim_calib) / sizeof(uint16_t); i++) {
+        uint16_t word = ((const uint16_t*) &sim_calib)[i];
+        // calibration words are little endian
+        regs[BMP280_CALIB + 2 * i] = word & 0xff;
+        regs[BMP280_CALIB + 2 * i + 1] = word >> 8;
+    }
+    regs[BMP280_CHIP_ID] = 0x58;
+    regs[BMP280_DATA] = BMP280_DATA_SKIPPED >> 12;
+    regs[BMP280_DATA + 3] = BMP280_DATA_SKIPPED >> 12;
+}
+
+// Register write, only forced mode of ctrl_meas is modelled
+static void sim_write_register(uint8_t reg, uint8_t value)
+{
+    sim_update();
+    switch (reg) {
+    case BMP280_SOFT_RESET:
+        if (value == 0xB6) {
+            sim_reset();
+        }
+        break;
+    case BMP280_CTRL_MEAS:
+        regs[reg] = value;
+        if ((value & 0x03) == 0x01 || (value & 0x03) == 0x02) {
+            sim_start_measurement(value);
+        }
+        break;
+    case BMP280_CONFIG:
+        regs[reg] = value;
+        filter_primed = false;
+        break;
+    default:
+        // calibration, id and data registers are read only
+        break;
+    }
+}
+
+/* Account for single transaction of 'len' bytes including address bytes
+   and 'conditions' start, repeated start and stop conditions
+ */
+static void sim_bus_transfer(unsigned int len, unsigned int conditions)
+{
+    stats.transactions++;
+    stats.bytes += len;
+    // each byte takes 9 clocks with ack bit
+    stats.bus_time_us += (conditions + 9 * len) * 1000000UL / bus_clock;
+}
+
+static void sim_read_registers(uint8_t* buf, unsigned int len)
+{
+    sim_update();
+    if (measuring && reg_pointer >= BMP280_DATA && reg_pointer <= BMP280_DATA + 5) {
+        stats.early_reads++;
+    }
+    for (unsigned int i = 0; i < len; i++) {
+        buf[i] = regs[reg_pointer++];
+    }
+}
+
+void bmp280_sim_init(const bmp280_sim_point* trace, size_t count, uint32_t seed)
+{
+    sim_trace = trace;
+    sim_trace_count = count;
+    noise_state = seed;
+    sim_start = xTaskGetTickCount();
+    reg_pointer = 0;
+    sim_reset();
+
+    bmp280_sim_reset_stats();
+    ESP_LOGD(TAG, "Initialized with %u trace points", (unsigned int) count);
+}
+
+void bmp280_sim_get_stats(bmp280_sim_stats* sim_stats)
+{
+    *sim_stats = stats;
+}
+
+void bmp280_sim_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void twi_init(unsigned char sda, unsigned char scl)
+{
+    twi_setClock(100000);
+}
+
+void twi_stop(void)
+{
+}
+
+void twi_setClock(unsigned int freq)
+{
+    bus_clock = freq;
+}
+
+/* Write sets register pointer with the first byte,
+   followed by pairs of data and address of the next register to write
+ */
+uint8_t twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    if (address != BMP280_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    sim_bus_transfer(len + 1, 2);
+    sim_update();
+    if (len == 0) {
+        return 0;
+    }
+    reg_pointer = buf[0];
+    for (unsigned int i = 1; i < len; i += 2) {
+        sim_write_register(buf[i - 1], buf[i]);
+    }
+    return 0;
+}
+
+uint8_t twi_readFrom(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop)
+{
+    if (address != BMP280_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    sim_bus_transfer(len + 1, 2);
+    sim_read_registers(buf, len);
+    return 0;
+}
+
+uint8_t twi_write_read(unsigned char address, unsigned char * wbuf, unsigned int wlen, unsigned char * rbuf, unsigned int rlen)
+{
+    if (rlen == 0) {
+        return twi_writeTo(address, wbuf, wlen, true);
+    }
+    if (address != BMP280_ADDRESS) {
+        sim_bus_transfer(1, 2);
+        stats.nacks++;
+        return 2;  // received NACK on transmit of address
+    }
+    // start + write address + data + repeated start + read address + data + stop
+    sim_bus_transfer(wlen + rlen + 2, 3);
+    if (wlen > 0) {
+        reg_pointer = wbuf[0];
+    }
+    sim_read_registers(rbuf, rlen);
+    return 0;
+}
+
+uint8_t twi_scan()
+{
+    uint8_t reg = 0x00;
+    uint8_t device_count = 0;
+
+    for (uint8_t i = 0; i < 127; i++) {
+        if (twi_writeTo(i, &reg, 1, true) == 0) {
+            ESP_LOGD(TAG, "Device found at 0x%02x", i);
+            device_count++;
+        }
+    }
+    return device_count;
+}
@@ -86,7 +86,7 @@ static void disconnected(uint32_t *args)
     client->proc_buf = NULL;
     client->proc_buf_size = 0;
 
-    ESP_LOGD(TAG, "Free heap %u", xPortGetFreeHeapSize());
+    ESP_LOGD(TAG, "Free heap %u", (unsigned int) xPortGetFreeHeapSize());
 }
 
 void keenio_post_data(altitude_data *altitude_record, unsigned long record_count)
@@ -41,6 +41,14 @@ static SemaphoreHandle_t sd_card_busy;
 // counter of data sets saved on SD card
 static unsigned long data_set_number = 0l;
 
+// called when card is mounted and unmounted
+static logger_card_activity_callback card_activity_cb = NULL;
+
+
+void logger_on_card_activity(logger_card_activity_callback card_activity)
+{
+    card_activity_cb = card_activity;
+}
 
 esp_err_t logger_open()
 {
@@ -68,6 +76,9 @@ esp_err_t logger_open()
     }
 
     logger_initialized = true;
+    if (card_activity_cb) {
+        card_activity_cb(true);
+    }
     sd_card_busy = xSemaphoreCreateBinary();
     xSemaphoreGive(sd_card_busy);
 
@@ -374,6 +385,9 @@ void logger_close(void)
 
     // All done, unmount partition and disable SDMMC host peripheral
     esp_vfs_fat_sdmmc_unmount();
+    if (card_activity_cb) {
+        card_activity_cb(false);
+    }
     ESP_LOGI(LOGGER_CLOSE, "Card unmounted");
 }
 
@@ -28,6 +28,17 @@ extern "C" {
 #define ESP_ERR_LOGGER_FILE_OPEN_READ_FAILED    (ESP_ERR_LOGGER_BASE + 4)
 #define ESP_ERR_LOGGER_FILE_OPEN_WRITE_FAILED   (ESP_ERR_LOGGER_BASE + 5)
 
+typedef void (*logger_card_activity_callback)(bool active);
+
+/**
+@brief Register function called with 'true' once SD card is mounted
+and with 'false' once it is unmounted
+
+Application may use it to account for power drawn by the card,
+e.g. logger_on_card_activity(energy_sd_card) before logger_open().
+*/
+void logger_on_card_activity(logger_card_activity_callback card_activity);
+
 esp_err_t logger_open();
 esp_err_t logger_save(altitude_data altitude_record);
 esp_err_t logger_peek(unsigned long* file_count);
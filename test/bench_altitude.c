@@ -0,0 +1,57 @@
+/*
+ bench_altitude.c - Speed of table driven pressure to altitude conversion against powf()
+
+ Run with 'make -C test bench', time is measured with real clock of the host.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "pressure_sensor.h"
+
+#define BENCH_CONVERSIONS 10000000
+#define BENCH_REFERENCE 101325
+
+typedef float (*altitude_function)(uint32_t pressure, unsigned long reference_pressure);
+
+static double bench_time_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Convert pressure sweeping 30 - 110 kPa, return time [ns] per conversion
+static double bench(altitude_function to_altitude)
+{
+    volatile float sink;
+    float sum = 0.0;
+
+    double start = bench_time_s();
+    for (uint32_t i = 0; i < BENCH_CONVERSIONS; i++) {
+        sum += to_altitude(30000 + i % 80000, BENCH_REFERENCE);
+    }
+    double elapsed = bench_time_s() - start;
+    sink = sum;
+    (void) sink;
+    return elapsed * 1e9 / BENCH_CONVERSIONS;
+}
+
+int main(void)
+{
+    // warm up, including initialization of tables
+    bench(pressure_sensor_altitude);
+
+    double table_ns = bench(pressure_sensor_altitude);
+    double exact_ns = bench(pressure_sensor_altitude_exact);
+    printf("Table %0.2f ns, powf() %0.2f ns per conversion, %0.1f times faster\n",
+        table_ns, exact_ns, exact_ns / table_ns);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ bench_sensor.c - Pressure sensor backends compared on simulated sensor
+
+ The same measurement loop runs through pressure_sensor interface,
+ built once for each backend with its simulator, see test/Makefile.
+ Run with 'make -C test bench', time is virtual time of the simulation.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "pressure_sensor.h"
+
+#if CONFIG_PRESSURE_SENSOR_BMP280
+#include "bmp280_sim.h"
+typedef bmp280_sim_point sim_point;
+typedef bmp280_sim_stats sim_stats;
+#define sim_init bmp280_sim_init
+#define sim_get_stats bmp280_sim_get_stats
+#define sim_reset_stats bmp280_sim_reset_stats
+#else
+#include "bmp180_sim.h"
+typedef bmp180_sim_point sim_point;
+typedef bmp180_sim_stats sim_stats;
+#define sim_init bmp180_sim_init
+#define sim_get_stats bmp180_sim_get_stats
+#define sim_reset_stats bmp180_sim_reset_stats
+#endif
+
+#define PIN_SDA 25
+#define PIN_SCL 27
+
+#define BENCH_SAMPLES 200
+#define BENCH_PRESSURE 95000
+#define BENCH_PERIOD_MS 15000  // Time between samples as in deep sleep mode
+
+static const char* level_names[] = {"low power", "standard", "high res", "ultra high res"};
+
+int main(void)
+{
+    static const sim_point trace[] = {
+        {0, BENCH_PRESSURE, 15.0}
+    };
+    float altitude_true = pressure_sensor_altitude(BENCH_PRESSURE, 101325);
+
+    sim_init(trace, 1, 12345);
+    if (pressure_sensor_init(PIN_SDA, PIN_SCL) != ESP_OK) {
+        printf("%s not initialized\n", pressure_sensor_name());
+        return 1;
+    }
+    for (uint8_t level = PRESSURE_SENSOR_LOW_POWER; level <= PRESSURE_SENSOR_ULTRA_HIGH_RES; level++) {
+        pressure_sensor_set_resolution(level);
+        sim_reset_stats();
+        TickType_t sample_ticks = 0;
+        double pressure_error = 0.0, altitude_error = 0.0;
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            pressure_sensor_data sample;
+            TickType_t start = xTaskGetTickCount();
+            if (pressure_sensor_start() != ESP_OK || pressure_sensor_read_sample(101325, &sample) != ESP_OK) {
+                printf("%s sample %d failed\n", pressure_sensor_name(), i);
+                return 1;
+            }
+            sample_ticks += xTaskGetTickCount() - start;
+            pressure_error += pow((double) sample.pressure - BENCH_PRESSURE, 2);
+            altitude_error += pow(sample.altitude - altitude_true, 2);
+            vTaskDelay(BENCH_PERIOD_MS / portTICK_RATE_MS);
+        }
+        sim_stats stats;
+        sim_get_stats(&stats);
+        printf("%s %-14s %5.1f ms, %4.1f transactions, %5lu us of bus, noise %4.2f Pa, %4.2f m per sample\n",
+            pressure_sensor_name(), level_names[level],
+            (double) sample_ticks * portTICK_RATE_MS / BENCH_SAMPLES,
+            (double) stats.transactions / BENCH_SAMPLES,
+            stats.bus_time_us / BENCH_SAMPLES,
+            sqrt(pressure_error / BENCH_SAMPLES), sqrt(altitude_error / BENCH_SAMPLES));
+    }
+    return 0;
+}
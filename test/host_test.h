@@ -0,0 +1,46 @@
+/*
+ host_test.h - Checks of host tests
+
+ Each test program counts failed checks and exits with their number,
+ so make stops on the first failing program.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <math.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) do { \
+    double v_ = (value), e_ = (expected); \
+    if (fabs(v_ - e_) > (tolerance)) { \
+        printf("%s:%d: check failed: %s = %g, expected %g +/- %g\n", \
+            __FILE__, __LINE__, #value, v_, e_, (double) (tolerance)); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define RUN_TEST(test) do { \
+    int failures_ = test_failures; \
+    test(); \
+    printf("%s %s\n", (test_failures == failures_) ? "PASS" : "FAIL", #test); \
+} while (0)
+
+#define TEST_EXIT() (test_failures > 0 ? 1 : 0)
+
+#endif  // HOST_TEST_H
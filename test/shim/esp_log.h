@@ -0,0 +1,30 @@
+/*
+ esp_log.h - Logging of ESP-IDF for host build
+
+ Debug and verbose messages are compiled out, still checking their format.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+uint32_t esp_log_timestamp(void);
+
+#define HOST_LOG(letter, tag, format, ...) \
+    printf(#letter " (%u) %s: " format "\n", esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { if (0) HOST_LOG(D, tag, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, format, ...) do { if (0) HOST_LOG(V, tag, format, ##__VA_ARGS__); } while (0)
+
+#endif  // HOST_ESP_LOG_H
@@ -0,0 +1,26 @@
+/*
+ rtc.h - Reset reason of ESP32 ROM for host build
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef HOST_ROM_RTC_H
+#define HOST_ROM_RTC_H
+
+typedef enum {
+    NO_MEAN = 0,
+    POWERON_RESET = 1,
+    DEEPSLEEP_RESET = 5
+} RESET_REASON;
+
+/**
+@brief Reset reason, power on unless changed with host_set_reset_reason()
+*/
+RESET_REASON rtc_get_reset_reason(int cpu_no);
+void host_set_reset_reason(RESET_REASON reason);
+
+#endif  // HOST_ROM_RTC_H
@@ -0,0 +1,21 @@
+/*
+ sdkconfig.h - Configuration of host build, defaults of menuconfig
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+#define CONFIG_RED_BLINK_GPIO 4
+#define CONFIG_GREEN_BLINK_GPIO 32
+#define CONFIG_BLUE_BLINK_GPIO 5
+
+#define CONFIG_THINGSPEAK_WRITE_API_KEY "1234567890123456"
+#define CONFIG_THINGSPEAK_CHANNEL_ID "123456"
+
+#endif  // HOST_SDKCONFIG_H
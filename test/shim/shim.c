@@ -0,0 +1,119 @@
+/*
+ shim.c - Virtual time, ROM functions and semaphores for host build
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "rom/crc.h"
+#include "rom/rtc.h"
+#include "driver/gpio.h"
+
+static TickType_t ticks = 0;
+static UBaseType_t task_priority = 5;
+static RESET_REASON reset_reason = POWERON_RESET;
+static int semaphore;
+
+
+TickType_t xTaskGetTickCount(void)
+{
+    return ticks;
+}
+
+void vTaskDelay(TickType_t delay)
+{
+    ticks += delay;
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t period)
+{
+    *previous_wake += period;
+    if ((int32_t) (*previous_wake - ticks) > 0) {
+        ticks = *previous_wake;
+    }
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return task_priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+{
+    task_priority = priority;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return &semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return ticks * portTICK_RATE_MS;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t) ticks * portTICK_RATE_MS * 1000;
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return 0;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+RESET_REASON rtc_get_reset_reason(int cpu_no)
+{
+    return reset_reason;
+}
+
+void host_set_reset_reason(RESET_REASON reason)
+{
+    reset_reason = reason;
+}
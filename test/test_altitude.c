@@ -0,0 +1,57 @@
+/*
+ test_altitude.c - Error bound of table driven pressure to altitude conversion
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "pressure_sensor.h"
+#include "host_test.h"
+
+// Error bound documented in pressure_sensor.h
+#define ALTITUDE_ERROR_BOUND 0.06
+
+static double altitude_reference(uint32_t pressure, unsigned long reference_pressure)
+{
+    return 44330 * (1.0 - pow(pressure / (double) reference_pressure, 0.190295));
+}
+
+// Pressure 30 - 110 kPa against reference pressure 90 - 106 kPa
+static void test_error_bound(void)
+{
+    double worst = 0.0;
+    uint32_t worst_pressure = 0;
+    unsigned long worst_reference = 0;
+
+    for (unsigned long reference = 90000; reference <= 106000; reference += 500) {
+        for (uint32_t pressure = 30000; pressure <= 110000; pressure += 7) {
+            double error = fabs(pressure_sensor_altitude(pressure, reference)
+                - altitude_reference(pressure, reference));
+            if (error > worst) {
+                worst = error;
+                worst_pressure = pressure;
+                worst_reference = reference;
+            }
+        }
+    }
+    printf("Worst error %0.4f m at %u Pa against %lu Pa\n", worst, worst_pressure, worst_reference);
+    CHECK(worst < ALTITUDE_ERROR_BOUND);
+}
+
+// Ratios outside of the table fall back to powf()
+static void test_out_of_table_range(void)
+{
+    CHECK_NEAR(pressure_sensor_altitude(1000, 101325), altitude_reference(1000, 101325), 0.5);
+    CHECK_NEAR(pressure_sensor_altitude(101325, 101325), 0.0, ALTITUDE_ERROR_BOUND);
+}
+
+int main(void)
+{
+    RUN_TEST(test_error_bound);
+    RUN_TEST(test_out_of_table_range);
+    return TEST_EXIT();
+}
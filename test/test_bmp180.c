@@ -0,0 +1,261 @@
+/*
+ test_bmp180.c - BMP180 driver running against simulated sensor
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "bmp180.h"
+#include "bmp180_sim.h"
+#include "pressure_sensor.h"
+#include "twi.h"
+#include "twi_bus.h"
+#include "host_test.h"
+
+#define PIN_SDA 25
+#define PIN_SCL 27
+
+// Example of calculation in BMP180 datasheet, the simulator has the same calibration
+static const bmp180_calibration datasheet_calibration = {
+    .ac1 = 408, .ac2 = -72, .ac3 = -14383,
+    .ac4 = 32741, .ac5 = 32757, .ac6 = 23153,
+    .b1 = 6190, .b2 = 4,
+    .mb = -32768, .mc = -8711, .md = 2868
+};
+#define DATASHEET_UT 27898
+#define DATASHEET_UP 23843
+#define DATASHEET_TEMPERATURE 15.0
+#define DATASHEET_PRESSURE 69964
+
+#define BMP180_ADDRESS 0x77
+#define BMP180_CAL_AC1 0xAA
+#define BMP180_CAL_SIZE 22
+
+// Register access of the driver, not in public API
+uint8_t bmp180_read_bytes(uint8_t reg, uint8_t* buff, unsigned int len);
+
+static const bmp180_sim_point datasheet_trace[] = {
+    {0, DATASHEET_PRESSURE, DATASHEET_TEMPERATURE}
+};
+
+
+static void test_compensate_datasheet_example(void)
+{
+    int16_t ut = DATASHEET_UT;
+    uint32_t up = DATASHEET_UP;
+    bmp180_raw_batch batch = {
+        .ut = &ut, .up = &up,
+        .reference_pressure = NULL, .oversampling = BMP180_ULTRA_LOW_POWER
+    };
+    bmp180_data sample;
+
+    bmp180_compensate_batch(&datasheet_calibration, &batch, &sample, 1);
+    CHECK(sample.pressure == DATASHEET_PRESSURE);
+    CHECK_NEAR(sample.temperature, DATASHEET_TEMPERATURE, 0.05);
+}
+
+static void test_read_datasheet_example(void)
+{
+    bmp180_sim_init(datasheet_trace, 1, 0);
+    bmp180_invalidate_calibration();
+    CHECK(bmp180_calibration_valid() == false);
+    CHECK(bmp180_init(PIN_SDA, PIN_SCL) == ESP_OK);
+
+    bmp180_calibration calibration;
+    bmp180_get_calibration(&calibration);
+    CHECK(memcmp(&calibration, &datasheet_calibration, sizeof(calibration)) == 0);
+    CHECK(bmp180_calibration_valid());
+
+    CHECK(bmp180_set_oversampling(BMP180_ULTRA_LOW_POWER) == ESP_OK);
+    bmp180_data sample;
+    CHECK(bmp180_read_sample(101325, &sample) == ESP_OK);
+    CHECK(sample.pressure == DATASHEET_PRESSURE);
+    CHECK_NEAR(sample.temperature, DATASHEET_TEMPERATURE, 0.05);
+    CHECK_NEAR(sample.altitude, pressure_sensor_altitude_exact(DATASHEET_PRESSURE, 101325), 0.1);
+}
+
+// Pressure of noisy samples at each oversampling follows the trace
+static void test_read_follows_trace(void)
+{
+    static const bmp180_sim_point trace[] = {
+        {0, 101325, 20.0},
+        {60000, 100125, 18.0}
+    };
+
+    bmp180_sim_init(trace, 2, 12345);
+    CHECK(bmp180_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    for (uint8_t oss = BMP180_ULTRA_LOW_POWER; oss <= BMP180_ULTRA_HIGH_RES; oss++) {
+        CHECK(bmp180_set_oversampling(oss) == ESP_OK);
+        bmp180_data sample;
+        CHECK(bmp180_read_sample(101325, &sample) == ESP_OK);
+        // noise is at most 6 Pa RMS, trace goes down 20 Pa per second
+        CHECK_NEAR(sample.pressure, 101325 - 20.0 * xTaskGetTickCount() / 1000, 30);
+        vTaskDelay(15000);
+    }
+    bmp180_sim_stats stats;
+    bmp180_sim_get_stats(&stats);
+    CHECK(stats.nacks == 0);
+    CHECK(stats.early_reads == 0);
+}
+
+/* Conversions run while the task does other work, e.g. Wi-Fi association,
+   so the sample is ready without waiting once the work is done
+ */
+static void test_conversion_overlaps_other_work(void)
+{
+    static const bmp180_sim_point trace[] = {
+        {0, 95000, 18.0}
+    };
+    const TickType_t work_ms = 100;  // other work, done in 10 ms slices
+    bmp180_data sequential, overlapped;
+
+    bmp180_sim_init(trace, 1, 0);
+    CHECK(bmp180_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    bmp180_set_temperature_reuse(0);
+    CHECK(bmp180_set_oversampling(BMP180_ULTRA_HIGH_RES) == ESP_OK);
+
+    TickType_t start = xTaskGetTickCount();
+    CHECK(bmp180_read_sample(101325, &sequential) == ESP_OK);
+    TickType_t conversion_ms = (xTaskGetTickCount() - start) * portTICK_RATE_MS;
+    vTaskDelay(work_ms / portTICK_RATE_MS);
+    TickType_t sequential_ms = (xTaskGetTickCount() - start) * portTICK_RATE_MS;
+
+    bmp180_sim_reset_stats();
+    start = xTaskGetTickCount();
+    CHECK(bmp180_start_sample() == ESP_OK);
+    for (TickType_t t = 0; t < work_ms; t += 10) {
+        vTaskDelay(10 / portTICK_RATE_MS);
+        bmp180_poll();
+    }
+    CHECK(bmp180_poll() == true);
+    CHECK(bmp180_collect(101325, &overlapped) == ESP_OK);
+    TickType_t overlapped_ms = (xTaskGetTickCount() - start) * portTICK_RATE_MS;
+
+    printf("Sequential %u ms, overlapped %u ms, conversions %u ms\n",
+        sequential_ms, overlapped_ms, conversion_ms);
+    // temperature and pressure at ultra high resolution take at least 4.5 + 25.5 ms
+    CHECK(conversion_ms >= 30);
+    CHECK(overlapped_ms == work_ms);
+    CHECK(sequential_ms - overlapped_ms == conversion_ms);
+    CHECK(overlapped.pressure == sequential.pressure);
+
+    bmp180_sim_stats stats;
+    bmp180_sim_get_stats(&stats);
+    CHECK(stats.conversions == 2);
+    CHECK(stats.early_reads == 0);
+}
+
+// Read 'len' registers one by one, each addressed with a separate write
+static void read_registers_singly(uint8_t reg, uint8_t* buff, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i++) {
+        uint8_t address = reg + i;
+        twi_writeTo(BMP180_ADDRESS, &address, 1, true);
+        twi_readFrom(BMP180_ADDRESS, &buff[i], 1, true);
+    }
+}
+
+// Read 'len' registers as 16 bit words, each addressed with a separate write
+static void read_registers_by_word(uint8_t reg, uint8_t* buff, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i += 2) {
+        uint8_t address = reg + i;
+        twi_writeTo(BMP180_ADDRESS, &address, 1, true);
+        twi_readFrom(BMP180_ADDRESS, &buff[i], 2, true);
+    }
+}
+
+/* Burst read of calibration block and result registers
+   with auto increment of register address against reading them
+   in separate transactions, as the driver did before
+ */
+static void test_burst_read_bus_time(void)
+{
+    uint8_t burst[BMP180_CAL_SIZE], by_word[BMP180_CAL_SIZE], singly[BMP180_CAL_SIZE];
+    bmp180_sim_stats burst_stats, by_word_stats, singly_stats;
+
+    bmp180_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp180_init(PIN_SDA, PIN_SCL) == ESP_OK);
+
+    bmp180_sim_reset_stats();
+    CHECK(bmp180_read_bytes(BMP180_CAL_AC1, burst, BMP180_CAL_SIZE) == 0);
+    bmp180_sim_get_stats(&burst_stats);
+    bmp180_sim_reset_stats();
+    read_registers_by_word(BMP180_CAL_AC1, by_word, BMP180_CAL_SIZE);
+    bmp180_sim_get_stats(&by_word_stats);
+    bmp180_sim_reset_stats();
+    read_registers_singly(BMP180_CAL_AC1, singly, BMP180_CAL_SIZE);
+    bmp180_sim_get_stats(&singly_stats);
+
+    printf("Calibration: burst %lu us in %lu transactions, by word %lu us in %lu, by byte %lu us in %lu\n",
+        burst_stats.bus_time_us, burst_stats.transactions,
+        by_word_stats.bus_time_us, by_word_stats.transactions,
+        singly_stats.bus_time_us, singly_stats.transactions);
+    CHECK(memcmp(burst, by_word, sizeof(burst)) == 0);
+    CHECK(memcmp(burst, singly, sizeof(burst)) == 0);
+    CHECK(burst_stats.transactions == 1);
+    CHECK(by_word_stats.transactions == 2 * BMP180_CAL_SIZE / 2);
+    CHECK(2 * burst_stats.bus_time_us < by_word_stats.bus_time_us);
+
+    // 3 byte pressure result
+    uint8_t result[3];
+    bmp180_sim_reset_stats();
+    CHECK(bmp180_read_bytes(0xF6, result, 3) == 0);
+    bmp180_sim_get_stats(&burst_stats);
+    bmp180_sim_reset_stats();
+    read_registers_singly(0xF6, result, 3);
+    bmp180_sim_get_stats(&singly_stats);
+    printf("Pressure result: burst %lu us, by byte %lu us\n",
+        burst_stats.bus_time_us, singly_stats.bus_time_us);
+    CHECK(2 * burst_stats.bus_time_us < singly_stats.bus_time_us);
+}
+
+// Powered down sensor gives its slot in device pool back to the bus
+static void test_power_down_releases_bus(void)
+{
+    twi_device* devices[TWI_BUS_MAX_DEVICES];
+
+    bmp180_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp180_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+    bmp180_pressure_sensor.power_down();
+
+    for (int i = 0; i < TWI_BUS_MAX_DEVICES; i++) {
+        devices[i] = twi_bus_add_device(PIN_SDA, PIN_SCL, 0x10 + i, 1);
+        CHECK(devices[i] != NULL);
+    }
+    for (int i = 0; i < TWI_BUS_MAX_DEVICES; i++) {
+        twi_bus_remove_device(devices[i]);
+    }
+    CHECK(bmp180_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+}
+
+// Scan goes through the bus lock and finds only the sensor, nothing once the bus is released
+static void test_bus_scan(void)
+{
+    bmp180_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp180_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(twi_bus_scan() == 1);
+    bmp180_pressure_sensor.power_down();
+    CHECK(twi_bus_scan() == 0);
+    CHECK(bmp180_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+}
+
+int main(void)
+{
+    RUN_TEST(test_compensate_datasheet_example);
+    RUN_TEST(test_read_datasheet_example);
+    RUN_TEST(test_read_follows_trace);
+    RUN_TEST(test_conversion_overlaps_other_work);
+    RUN_TEST(test_burst_read_bus_time);
+    RUN_TEST(test_power_down_releases_bus);
+    RUN_TEST(test_bus_scan);
+    return TEST_EXIT();
+}
@@ -0,0 +1,157 @@
+/*
+ test_bmp280.c - BMP280 driver running against simulated sensor
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "bmp280.h"
+#include "bmp280_sim.h"
+#include "pressure_sensor.h"
+#include "twi_bus.h"
+#include "host_test.h"
+
+#define PIN_SDA 25
+#define PIN_SCL 27
+
+// Example of calculation in BMP280 datasheet, the simulator has the same calibration
+#define DATASHEET_TEMPERATURE 25.08
+#define DATASHEET_PRESSURE 100653
+
+static const bmp280_sim_point datasheet_trace[] = {
+    {0, DATASHEET_PRESSURE, DATASHEET_TEMPERATURE}
+};
+
+static void test_read_datasheet_example(void)
+{
+    bmp280_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp280_init(PIN_SDA, PIN_SCL) == ESP_OK);
+
+    bmp280_data sample;
+    CHECK(bmp280_start() == ESP_OK);
+    CHECK(bmp280_collect(&sample) == ESP_OK);
+    CHECK_NEAR(sample.pressure, DATASHEET_PRESSURE, 1);
+    CHECK_NEAR(sample.temperature, DATASHEET_TEMPERATURE, 0.01);
+}
+
+// Data registers keep the previous result, so it may not be collected twice
+static void test_collect_needs_start(void)
+{
+    bmp280_data sample;
+
+    bmp280_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp280_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(bmp280_collect(&sample) == ESP_ERR_BMP280_NOT_STARTED);
+    CHECK(bmp280_start() == ESP_OK);
+    CHECK(bmp280_collect(&sample) == ESP_OK);
+    CHECK(bmp280_collect(&sample) == ESP_ERR_BMP280_NOT_STARTED);
+}
+
+// Pressure of noisy samples at each resolution follows the trace
+static void test_read_follows_trace(void)
+{
+    static const bmp280_sim_point trace[] = {
+        {0, 101325, 20.0},
+        {60000, 100125, 18.0}
+    };
+
+    bmp280_sim_init(trace, 2, 12345);
+    CHECK(bmp280_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+    for (uint8_t level = PRESSURE_SENSOR_LOW_POWER; level <= PRESSURE_SENSOR_ULTRA_HIGH_RES; level++) {
+        CHECK(bmp280_pressure_sensor.set_resolution(level) == ESP_OK);
+        pressure_sensor_data sample;
+        CHECK(bmp280_pressure_sensor.start() == ESP_OK);
+        CHECK(bmp280_pressure_sensor.read_sample(&sample) == ESP_OK);
+        // noise is below 3 Pa RMS, trace goes down 20 Pa per second
+        CHECK_NEAR(sample.pressure, 101325 - 20.0 * xTaskGetTickCount() / 1000, 15);
+        vTaskDelay(15000);
+    }
+    bmp280_sim_stats stats;
+    bmp280_sim_get_stats(&stats);
+    CHECK(stats.nacks == 0);
+    CHECK(stats.early_reads == 0);
+    CHECK(stats.conversions == 4);
+}
+
+// Pressure and temperature are collected with single burst read
+static void test_burst_read(void)
+{
+    bmp280_data sample;
+
+    bmp280_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp280_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(bmp280_start() == ESP_OK);
+    vTaskDelay(50);
+    bmp280_sim_reset_stats();
+    CHECK(bmp280_collect(&sample) == ESP_OK);
+    bmp280_sim_stats stats;
+    bmp280_sim_get_stats(&stats);
+    CHECK(stats.transactions == 1);
+    CHECK(stats.bytes == 6 + 3);
+}
+
+/* Step of pressure by 12 Pa (about 1 m) between forced samples
+   shows in full with filter off, and only partly with filter on
+ */
+static void test_filter_off_follows_step(void)
+{
+    static const bmp280_sim_point trace[] = {
+        {0, 95000, 15.0},
+        {10000, 95000, 15.0},
+        {10001, 94988, 15.0}
+    };
+    bmp280_data before, after;
+
+    bmp280_sim_init(trace, 3, 0);
+    CHECK(bmp280_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(bmp280_start() == ESP_OK && bmp280_collect(&before) == ESP_OK);
+    vTaskDelay(15000);
+    CHECK(bmp280_start() == ESP_OK && bmp280_collect(&after) == ESP_OK);
+    CHECK_NEAR((double) before.pressure - after.pressure, 12, 1);
+
+    bmp280_sim_init(trace, 3, 0);
+    CHECK(bmp280_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(bmp280_set_filter(BMP280_FILTER_4) == ESP_OK);
+    CHECK(bmp280_start() == ESP_OK && bmp280_collect(&before) == ESP_OK);
+    vTaskDelay(15000);
+    CHECK(bmp280_start() == ESP_OK && bmp280_collect(&after) == ESP_OK);
+    CHECK((double) before.pressure - after.pressure < 6);
+    CHECK(bmp280_set_filter(BMP280_FILTER_OFF) == ESP_OK);
+}
+
+// Powered down sensor gives its slot in device pool back to the bus
+static void test_power_down_releases_bus(void)
+{
+    twi_device* devices[TWI_BUS_MAX_DEVICES];
+
+    bmp280_sim_init(datasheet_trace, 1, 0);
+    CHECK(bmp280_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+    bmp280_pressure_sensor.power_down();
+
+    for (int i = 0; i < TWI_BUS_MAX_DEVICES; i++) {
+        devices[i] = twi_bus_add_device(PIN_SDA, PIN_SCL, 0x10 + i, 1);
+        CHECK(devices[i] != NULL);
+    }
+    for (int i = 0; i < TWI_BUS_MAX_DEVICES; i++) {
+        twi_bus_remove_device(devices[i]);
+    }
+    CHECK(bmp280_pressure_sensor.init(PIN_SDA, PIN_SCL) == ESP_OK);
+}
+
+int main(void)
+{
+    RUN_TEST(test_read_datasheet_example);
+    RUN_TEST(test_collect_needs_start);
+    RUN_TEST(test_read_follows_trace);
+    RUN_TEST(test_burst_read);
+    RUN_TEST(test_filter_off_follows_step);
+    RUN_TEST(test_power_down_releases_bus);
+    return TEST_EXIT();
+}
@@ -0,0 +1,198 @@
+/*
+ test_scheduler.c - Replay of stair run through simulated sensor and sample scheduler
+
+ Trace follows the pattern of Everest Run in the log book:
+ laps of 30 min climb up the stairs, elevator ride down and a short rest,
+ with a long break in the middle.
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "bmp180.h"
+#include "pressure_sensor.h"
+#include "bmp180_sim.h"
+#include "sample_scheduler.h"
+#include "host_test.h"
+
+#define PIN_SDA 25
+#define PIN_SCL 27
+#define STANDARD_PRESSURE 101325
+
+// Defaults of menuconfig
+static const sample_scheduler_config config = {
+    .altitude_step = 5,
+    .period_min = 5,
+    .period_max = 60,
+    .refresh_min = 300,
+    .refresh_max = 3600
+};
+
+// Altitude climbed is counted as in altimeter.c
+#define ALTITUDE_DISRIMINATION 1.5
+
+#define LAP_S (40 * 60)  // 30 min climb at 0.25 m/s, 3 min down, 7 min rest
+#define LAP_CLIMB_S (30 * 60)
+#define LAP_DOWN_S (3 * 60)
+#define CLIMB_SPEED 0.25
+#define BREAK_S (45 * 60)  // after the first half of laps
+#define LAPS 8
+#define RUN_S (LAPS * LAP_S + BREAK_S)
+#define TRACE_STEP_S 30
+#define TRACE_POINTS (RUN_S / TRACE_STEP_S + 1)
+
+static bmp180_sim_point trace[TRACE_POINTS];
+
+typedef struct {
+    unsigned int samples;
+    float climbed;
+    unsigned int period_max;
+    unsigned long climb_samples;  // samples taken while climbing
+    unsigned long climb_period_sum;
+} replay_result;
+
+
+static float altitude_at(unsigned int t)
+{
+    if (t >= LAPS / 2 * LAP_S) {
+        if (t < LAPS / 2 * LAP_S + BREAK_S) {
+            return 0.0;
+        }
+        t -= BREAK_S;
+    }
+    unsigned int lap_time = t % LAP_S;
+    if (lap_time < LAP_CLIMB_S) {
+        return lap_time * CLIMB_SPEED;
+    }
+    if (lap_time < LAP_CLIMB_S + LAP_DOWN_S) {
+        return LAP_CLIMB_S * CLIMB_SPEED * (1.0 - (lap_time - LAP_CLIMB_S) / (float) LAP_DOWN_S);
+    }
+    return 0.0;
+}
+
+static bool climbing_at(unsigned int t)
+{
+    if (t >= LAPS / 2 * LAP_S) {
+        if (t < LAPS / 2 * LAP_S + BREAK_S) {
+            return false;
+        }
+        t -= BREAK_S;
+    }
+    return t % LAP_S < LAP_CLIMB_S;
+}
+
+static void trace_init(void)
+{
+    for (int i = 0; i < TRACE_POINTS; i++) {
+        unsigned int t = i * TRACE_STEP_S;
+        trace[i].time_ms = t * 1000ul;
+        trace[i].pressure = STANDARD_PRESSURE * pow(1.0 - altitude_at(t) / 44330.0, 1.0 / 0.190295);
+        trace[i].temperature = 20.0 - altitude_at(t) * 0.0065;
+    }
+}
+
+// Sample the trace with period set by scheduler, or fixed 'period' if not 0
+static void replay(unsigned int fixed_period, replay_result* result)
+{
+    sample_scheduler scheduler;
+    float altitude_last = 0.0;
+    bool primed = false;
+    unsigned int period = config.period_min;
+
+    sample_scheduler_init(&scheduler, &config);
+    bmp180_sim_init(trace, TRACE_POINTS, 12345);
+    CHECK(bmp180_init(PIN_SDA, PIN_SCL) == ESP_OK);
+    CHECK(bmp180_set_oversampling(BMP180_ULTRA_HIGH_RES) == ESP_OK);
+    *result = (replay_result) {0};
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_wake = start;
+    while ((xTaskGetTickCount() - start) * portTICK_RATE_MS < RUN_S * 1000ul) {
+        unsigned int t = (xTaskGetTickCount() - start) * portTICK_RATE_MS / 1000;
+        bmp180_data sample;
+        CHECK(bmp180_read_sample(STANDARD_PRESSURE, &sample) == ESP_OK);
+        float altitude = pressure_sensor_altitude(sample.pressure, STANDARD_PRESSURE);
+        if (primed && altitude - altitude_last > ALTITUDE_DISRIMINATION) {
+            result->climbed += altitude - altitude_last;
+        }
+        primed = true;
+        altitude_last = altitude;
+        result->samples++;
+
+        unsigned int elapsed = period;
+        period = sample_scheduler_update(&scheduler, altitude, elapsed);
+        if (fixed_period != 0) {
+            period = fixed_period;
+        }
+        if (period > result->period_max) {
+            result->period_max = period;
+        }
+        if (climbing_at(t)) {
+            result->climb_samples++;
+            result->climb_period_sum += period;
+        }
+        vTaskDelayUntil(&last_wake, period * 1000 / portTICK_RATE_MS);
+    }
+}
+
+static void test_replay_stair_run(void)
+{
+    const float climbed = LAPS * LAP_CLIMB_S * CLIMB_SPEED;
+    replay_result fixed, adaptive;
+
+    trace_init();
+    replay(15, &fixed);
+    replay(0, &adaptive);
+
+    printf("Fixed 15 s: %u samples, climbed %0.0f m\n", fixed.samples, fixed.climbed);
+    printf("Adaptive: %u samples, climbed %0.0f m, longest period %u s, average period climbing %0.1f s\n",
+        adaptive.samples, adaptive.climbed, adaptive.period_max,
+        adaptive.climb_period_sum / (float) adaptive.climb_samples);
+    printf("True climb %0.0f m\n", climbed);
+
+    CHECK_NEAR(fixed.climbed, climbed, 0.02 * climbed);
+    CHECK_NEAR(adaptive.climbed, climbed, 0.02 * climbed);
+    // slow while resting, about 'altitude_step' apart while climbing
+    CHECK(adaptive.samples < 0.75 * fixed.samples);
+    CHECK(adaptive.period_max == config.period_max);
+    CHECK_NEAR(adaptive.climb_period_sum / (float) adaptive.climb_samples,
+        config.altitude_step / CLIMB_SPEED, 5.0);
+}
+
+static void test_reference_refresh_backoff(void)
+{
+    sample_scheduler scheduler;
+
+    sample_scheduler_init(&scheduler, &config);
+    CHECK(sample_scheduler_reference_due(&scheduler) == false);
+    sample_scheduler_update(&scheduler, 0.0, config.refresh_min);
+    CHECK(sample_scheduler_reference_due(&scheduler) == true);
+
+    // interval doubles while reference stays within 50 Pa, up to the maximum
+    unsigned int expected = config.refresh_min;
+    for (int i = 0; i < 6; i++) {
+        sample_scheduler_reference_updated(&scheduler, 101300, 101320);
+        expected = (2 * expected > config.refresh_max) ? config.refresh_max : 2 * expected;
+        CHECK(scheduler.refresh_interval == expected);
+        CHECK(sample_scheduler_reference_due(&scheduler) == false);
+    }
+    CHECK(scheduler.refresh_interval == config.refresh_max);
+
+    // and drops back once reference changes
+    sample_scheduler_reference_updated(&scheduler, 101320, 101200);
+    CHECK(scheduler.refresh_interval == config.refresh_min);
+}
+
+int main(void)
+{
+    RUN_TEST(test_replay_stair_run);
+    RUN_TEST(test_reference_refresh_backoff);
+    return TEST_EXIT();
+}
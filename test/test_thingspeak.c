@@ -0,0 +1,133 @@
+/*
+ test_thingspeak.c - Bulk update of records from buffer, with request captured in place of HTTP client
+
+ This file is part of the ESP32 Everest Run project
+ https://github.com/krzychb/esp32-everest-run
+
+ Copyright (c) 2016 Krzysztof Budzynski <krzychb@gazeta.pl>
+ This work is licensed under the Apache License, Version 2.0, January 2004
+ See the file LICENSE for details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "altitude_buffer.h"
+#include "thingspeak.h"
+#include "http.h"
+#include "host_test.h"
+
+#define SAMPLE_PERIOD 15  // Seconds between records
+#define RECORDS 4
+
+static http_callback disconnected_cb;
+static char request[4096];
+static const char* response = "HTTP/1.1 202 Accepted\r\n\r\n{\"success\":true}";
+
+
+void http_client_on_process_chunk(http_client_data* client, http_callback cb)
+{
+}
+
+void http_client_on_disconnected(http_client_data* client, http_callback cb)
+{
+    disconnected_cb = cb;
+}
+
+// Save request and respond as server would
+esp_err_t http_client_request(http_client_data* client, const char* web_server, const char* request_string)
+{
+    strncpy(request, request_string, sizeof(request) - 1);
+    client->proc_buf = strdup(response);
+    client->proc_buf_size = strlen(response) + 1;
+    disconnected_cb((uint32_t*) client);
+    return ESP_OK;
+}
+
+static int count_occurrences(const char* s, const char* what)
+{
+    int count = 0;
+    while ((s = strstr(s, what)) != NULL) {
+        count++;
+        s += strlen(what);
+    }
+    return count;
+}
+
+// Post records taken every SAMPLE_PERIOD starting at 'start' and fetched from the buffer
+static esp_err_t post_records(time_t start)
+{
+    altitude_data records[RECORDS];
+
+    altitude_buffer_drop(altitude_buffer_count());
+    for (int i = 0; i < RECORDS; i++) {
+        altitude_data record = {0};
+        record.pressure = 100000 - i * 10;
+        record.temperature = 21.5;
+        record.timestamp = start + i * SAMPLE_PERIOD;
+        record.up_time = 120 + i * SAMPLE_PERIOD;
+        altitude_buffer_put(&record);
+    }
+    size_t count = altitude_buffer_peek(records, RECORDS);
+    CHECK(count == RECORDS);
+    for (size_t i = 0; i < count; i++) {
+        records[i].reference_pressure = 101325;
+    }
+    request[0] = '\0';
+    return thinkgspeak_post_batch(records, count);
+}
+
+static void check_content_length(void)
+{
+    const char* body = strstr(request, "\n\n");
+    const char* length = strstr(request, "Content-Length: ");
+    CHECK(body != NULL && length != NULL);
+    if (body != NULL && length != NULL) {
+        CHECK(atoi(length + strlen("Content-Length: ")) == (int) strlen(body + 2));
+    }
+}
+
+/* Without NTP calendar time counts from boot,
+   every record is placed relative to the newest one
+ */
+static void test_post_with_clock_unset(void)
+{
+    CHECK(post_records(120) == ESP_OK);
+    printf("%s\n", strstr(request, "{\"write_api_key\""));
+    check_content_length();
+    CHECK(count_occurrences(request, "\"delta_t\":") == RECORDS);
+    CHECK(count_occurrences(request, "\"created_at\"") == 0);
+    CHECK(strstr(request, "{\"delta_t\":45,\"field1\":100000,") != NULL);
+    CHECK(strstr(request, "{\"delta_t\":30,\"field1\":99990,") != NULL);
+    CHECK(strstr(request, "{\"delta_t\":15,\"field1\":99980,") != NULL);
+    CHECK(strstr(request, "{\"delta_t\":0,\"field1\":99970,") != NULL);
+    CHECK(strstr(request, "},]") == NULL);
+}
+
+static void test_post_with_clock_set(void)
+{
+    setenv("TZ", "UTC", 1);
+    CHECK(post_records(1500000000) == ESP_OK);
+    check_content_length();
+    CHECK(count_occurrences(request, "\"delta_t\":") == RECORDS);
+    CHECK(count_occurrences(request, "\"created_at\"") == RECORDS);
+    CHECK(strstr(request, "{\"created_at\":\"2017-07-14 02:40:00 +0000\",\"delta_t\":45,") != NULL);
+    // up time is kept apart from calendar time
+    CHECK(strstr(request, "\"field8\":165}") != NULL);
+}
+
+static void test_rejected_post(void)
+{
+    response = "HTTP/1.1 400 Bad Request\r\n\r\n";
+    CHECK(post_records(120) == ESP_ERR_THINGSPEAK_POST_FAILED);
+    response = "HTTP/1.1 202 Accepted\r\n\r\n{\"success\":true}";
+}
+
+int main(void)
+{
+    thinkgspeak_initialise();
+    RUN_TEST(test_post_with_clock_unset);
+    RUN_TEST(test_post_with_clock_set);
+    RUN_TEST(test_rejected_post);
+    return TEST_EXIT();
+}